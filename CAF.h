@@ -4,18 +4,59 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "Ntuple/NtpMCEventRecord.h"
+#include "CAFColumns.h"
+#include "IOProfile.h"
+#include <map>
+#include <vector>
+
+// on-disk encoding of the reweight branches
+// kWgtRatio16 stores each shift as its ratio to the CV weight, quantised to 16 bits over [0, wgtRatioMax];
+// it only applies to weights, "var" knobs fall back to float
+enum WeightPrecision { kWgtDouble = 0, kWgtFloat = 1, kWgtRatio16 = 2 };
+const double wgtRatioMax = 4.;
+
+// what goes into the genieEvt tree
+// kGenieFull: the whole NtpMCEventRecord, re-streamed for every CAF entry (genie_record branch)
+// kGenieRef:  only (ghep_file, ghep_entry) per CAF entry, with the file paths in the ghepFiles tree
+// kGenieRaw:  the gtree of every GHEP file used, fast-copied without re-streaming; the genieIdx tree
+//             gives the genieEvt entry for each CAF entry
+// GenieRecordReader gets the record back for any of them
+enum GenieMode { kGenieFull = 0, kGenieRef = 1, kGenieRaw = 2 };
+
+// precision of the floating-point caf variables, picked at build time with make PRECISION=float|double32
+// double (default): double in memory and on disk, the schema to validate the others against
+// CAF_FLOAT:        float in memory and on disk
+// CAF_DOUBLE32:     double in memory, truncated to float on disk when the entry is filled (Double32_t without a range)
+// the meta tree's real_precision says which one a file has
+#ifdef CAF_FLOAT
+typedef float caf_real;
+#else
+typedef double caf_real;
+#endif
+enum RealPrecision { kRealDouble = 0, kRealFloat = 1, kRealDouble32 = 2 };
+const int kMaxReal = 64; // floating-point caf branches
 
 class CAF {
 
 public:
-  CAF( std::string filename, bool isGas = false );
+  CAF( std::string filename, bool isGas = false, int genieMode = kGenieFull, std::string ioProfile = "default" );
+  CAF(); // event buffer only, no output file or trees
   ~CAF();
-  void fill();
+  void fill(); // with the writer on, queues a copy of the event and returns
   void fillPOT();
-  void write();
-  void addRWbranch( int parId, std::string name, std::string wgt_var, std::vector<double> &vars );
+  void write(); // also prints ioReport()
+  void ioReport(); // size and compression of every caf branch, and fill/write time of each tree
+  void addRWbranch( int parId, std::string name, std::string wgt_var, std::vector<double> &vars, int precision = kWgtDouble );
+  void useRWLayout( const CAF &master ); // size an event buffer's weights like the CAF that owns the branches
+  void setWeights( int parId, double cv, const std::vector<double> &responses );
+  void addGHEPFile( int fileNo, std::string path ); // call before the first event from each GHEP file
+  void setGHEPEntry( int fileNo, int entry ); // where this event's record lives
+  bool addColumnOutput( std::string filename ); // also write the caf tree as a Parquet file, call before the first fill
+  void startWriter( int depth ); // fill the trees on a background thread, up to depth events queued; after addRWbranch
+  void drain(); // wait for the writer to fill everything queued so far
   void Print();
   void setToBS();
+  void copyEvent( const CAF &src );
 
   // Make ntuple variables public so they can be set from other file
 
@@ -25,22 +66,22 @@ public:
   int run, subrun, event;
   // Truth information
   int isCC, neutrinoPDG, neutrinoPDGunosc, mode, LepPDG; 
-  double Ev, Q2, W, X, Y, NuMomX, NuMomY, NuMomZ, LepMomX, LepMomY, LepMomZ, LepE, LepNuAngle;
+  caf_real Ev, Q2, W, X, Y, NuMomX, NuMomY, NuMomZ, LepMomX, LepMomY, LepMomZ, LepE, LepNuAngle;
   // True particle counts
   int nP, nN, nipip, nipim, nipi0, nikp, nikm, nik0, niem, niother, nNucleus, nUNKNOWN;
-  double eP, eN, ePip, ePim, ePi0, eOther;
-  double eRecoP, eRecoN, eRecoPip, eRecoPim, eRecoPi0, eRecoOther;
+  caf_real eP, eN, ePip, ePim, ePi0, eOther;
+  caf_real eRecoP, eRecoN, eRecoPip, eRecoPim, eRecoPi0, eRecoOther;
 
   // vertex -- smear it?
-  double vtx_x, vtx_y, vtx_z;
-  double det_x;
+  caf_real vtx_x, vtx_y, vtx_z;
+  caf_real det_x;
 
   // Reco information CV
-  double Ev_reco, Elep_reco, theta_reco;
+  caf_real Ev_reco, Elep_reco, theta_reco;
   int reco_numu, reco_nue, reco_nc, reco_q;
   int muon_contained, muon_tracker, muon_ecal, muon_exit, reco_lepton_pdg;
-  double Ehad_veto;
-  double pileup_energy;
+  caf_real Ehad_veto;
+  caf_real pileup_energy;
 
   // Gas TPC variables
   int gastpc_pi_min_mult, gastpc_pi_pl_mult;
@@ -48,18 +89,24 @@ public:
   int pdg[100];
   double trkLen[100], trkLenPerp[100], ptrue[100], partEvReco[100];
 
-  // reweights -- make sure big enough to hold all the variations for each knob, and all the knobs
+  // reweights, indexed by parameter id; wgt[id] is sized to that knob's shifts when it is registered, NULL otherwise
   // the names, and what they actually mean, are determined automatically from the fhicl input file
   int nwgt[100];
   double cvwgt[100];
-  double wgt[100][100];
+  double * wgt[100];
   bool iswgt[100];
+  std::vector<int> rwIds; // registered parameter ids, the only ones reset and copied per event
+  int rwSize[100];
 
   // store the GENIE record as a branch
   genie::NtpMCEventRecord * mcrec;
+  int genieMode;
+  int ghep_file, ghep_entry;
+  Long64_t genie_entry;
 
   // meta
   double pot;
+  int realPrecision;
   int meta_run, meta_subrun;
   int version;
 
@@ -67,6 +114,46 @@ public:
   TTree * cafMVA;
   TTree * cafPOT;
   TTree * genie;
+  TTree * genieIdx; // kGenieRaw only
+  TTree * ghepFiles; // kGenieRef and kGenieRaw
+  CAFColumns * columns; // optional columnar copy of cafMVA
+
+private:
+  struct Writer;
+
+  void initRW();
+  int encodeRW(); // returns how many 16-bit ratios were clamped
+  void branchReal( const char * name, caf_real * var );
+  void encodeReals();
+  void fillTrees( CAF &ev );
+  void writerLoop();
+  void stopWriter();
+  static void * relocate( void * addr, const CAF &from, CAF &to );
+  static void moveBranches( TTree * tree, const CAF &from, CAF &to );
+
+  // reduced-precision copies of the weights, filled from wgt just before each Fill
+  int rwPrecision[100];
+  float cvwgtF[100];
+  float * wgtF[100];
+  unsigned short * wgtQ[100];
+  double wgtRatioScale;
+  Long64_t wgtClamped; // 16-bit ratios outside [0, wgtRatioMax], reported by write()
+
+  // float copies of the caf_real branches for CAF_DOUBLE32
+  caf_real * realVar[kMaxReal];
+  float realDisk[kMaxReal];
+  int nReal;
+
+  // output tuning, and time spent in Fill and Write
+  const IOProfile * profile;
+  double cafFillTime, genieFillTime;
+  std::map<std::string, double> writeTime;
+  Writer * writer; // NULL when the trees are filled on the calling thread
+
+  // GHEP files seen so far, and where each one starts in genieEvt for kGenieRaw
+  std::map<int, Long64_t> ghepOffset;
+  char ghepPath[1024];
+  Long64_t ghepFirst;
 };
 
 #endif
@@ -0,0 +1,57 @@
+#ifndef CAFColumns_h
+#define CAFColumns_h
+
+#include "TTree.h"
+#include "TLeaf.h"
+#include <string>
+#include <vector>
+
+#ifdef CAF_PARQUET
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <parquet/arrow/writer.h>
+#endif
+
+// Columnar (Apache Parquet) copy of a flat TTree, used for the caf tree
+// The schema comes from the tree's leaves the first time fill() is called, after all the reweight branches
+// exist, so it is the TTree schema: each scalar leaf becomes a column of the same type, and each [n] leaf
+// becomes a list column. Values are read from the leaf addresses, so it works both for a tree being filled
+// (CAF) and for one being read back with GetEntry (benchCAF).
+// Parquet needs Arrow; build with PARQUET=1 (defines CAF_PARQUET). Otherwise ok() is always false.
+class CAFColumns {
+
+public:
+  CAFColumns( TTree * tree, std::string filename, int rowGroupSize = 65536 );
+  ~CAFColumns();
+
+  bool ok() const { return good; }
+  void fill(); // append the tree's current entry
+  void close(); // write the last row group and the file footer
+
+  static bool available();
+
+private:
+  void init();
+  void flush();
+
+  TTree * tree;
+  std::string filename;
+  int rowGroupSize;
+  int rows; // in the current row group
+  bool good, started;
+
+#ifdef CAF_PARQUET
+  struct Column {
+    TLeaf * leaf;
+    TLeaf * count; // length leaf for [n] arrays, NULL for scalars
+    char type; // leaf type code: I F D s L
+    std::shared_ptr<arrow::ArrayBuilder> values;
+    std::shared_ptr<arrow::ListBuilder> list; // wraps values for [n] leaves
+  };
+  std::vector<Column> columns;
+  std::shared_ptr<arrow::Schema> schema;
+  std::unique_ptr<parquet::arrow::FileWriter> writer;
+#endif
+};
+
+#endif
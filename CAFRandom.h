@@ -0,0 +1,31 @@
+#ifndef CAFRandom_h
+#define CAFRandom_h
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al., SC'11)
+// A stream is keyed on (seed, run, subrun, event, stream), and the n-th number in it is a pure function
+// of that key and n. So any single event, any range of events or any shard gets exactly the same
+// numbers it would get in a full sequential job, regardless of thread or processing order.
+// The interface follows TRandom, so it can stand in for the old global TRandom3
+
+class CAFRandom {
+
+public:
+  CAFRandom( unsigned int seed, int run, int subrun, int event, unsigned int stream = 0 );
+
+  double Rndm();                                  // uniform on (0,1)
+  double Gaus( double mean = 0., double sigma = 1. );
+  double Exp( double tau );
+  void RndmArray( int n, double * array );        // n uniforms, the same ones n calls to Rndm would give
+  unsigned int Integer32();                       // raw 32 random bits
+  unsigned int Seed();                            // non-zero 32 bits, for seeding a TRandom that we don't control
+
+private:
+  void nextBlock();
+
+  unsigned int key[2];
+  unsigned int ctr[4];
+  unsigned int block[4];
+  int used; // how many words of block have been handed out
+};
+
+#endif
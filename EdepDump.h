@@ -0,0 +1,113 @@
+#ifndef EdepDump_h
+#define EdepDump_h
+
+#include "TChain.h"
+#include "TGeoManager.h"
+#include "TGeoNode.h"
+#include "TTree.h"
+#include "TG4Event.h"
+#include "HitAccumulator.h"
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One dumpTree entry: truth and edep-sim summary for one primary vertex
+struct DumpEvent {
+  int ifileNo, ievt, lepPdg, muonReco, nFS;
+  float lepKE, muGArLen, hadTot, hadCollar;
+  float hadP, hadN, hadPip, hadPim, hadPi0, hadOther;
+  float p3lep[3], vtx[3], lepDeath[3], muonExitPt[3], muonExitMom[3];
+  int fsPdg[100];
+  float fsPx[100], fsPy[100], fsPz[100], fsE[100], fsTrkLen[100], fsTrkLenPerp[100];
+};
+
+// Reads edep-sim output files directly and makes the same per-vertex summary as dumpTree.py
+// (dumpTree_gas.py with isGas), so makeCAF does not need the intermediate dump.root
+// Every geometry node is classified once when the geometry is loaded, so the muon trajectory walk is a
+// navigator query and a table lookup instead of string matching. Each of nthreads slots has its own
+// TChain, and each calling thread gets its own navigator; different slots can be processed concurrently.
+class EdepDump {
+
+public:
+  EdepDump( std::string topdir, int first_run, int last_run, bool rhc, bool grid, bool isGas, int nthreads = 1 );
+  ~EdepDump();
+
+  int entries() const { return N; }
+  int fileNo( int ient ) const { return okruns[ient/evt_per_file]; }
+  int eventNo( int ient ) const { return ient % evt_per_file; }
+  const std::vector<std::string> & files() const { return okfiles; } // file k has entries from k*eventsPerFile()
+  int eventsPerFile() const { return evt_per_file; }
+
+  // read edep-sim entry ient with this slot's chain and append one DumpEvent per primary vertex, returns how many
+  int process( int ient, std::vector<DumpEvent> &out, int slot = 0 );
+
+  // how many DumpEvents process() gives for entries [first, last), from the primaries alone
+  // dumpTree numbers its entries in this order, so this is the dump tree entry of entry last's first vertex
+  int countVertices( int first, int last );
+
+private:
+  struct VolumeClass {
+    bool active; // inside the active LAr (GAr with isGas)
+    int endVol; // where the muon died, dumpTree.py endVolIdx
+  };
+
+  bool active( const char * volName ) const;
+  int endVolume( const char * volName ) const;
+  void classifyNodes();
+  VolumeClass classify( TGeoNode * node ) const;
+
+  bool isGas;
+  std::vector<TChain*> events;
+  std::vector<TG4Event*> records; // event buffer for each chain
+  std::vector<HitAccumulator*> hits; // and hit sums
+  TGeoManager * tgeo;
+  std::unordered_map<const TGeoNode*, VolumeClass> nodeClass;
+  std::vector<int> okruns;
+  std::vector<std::string> okfiles;
+  int N, evt_per_file;
+};
+
+// Hands dump events to the makeCAF loop in order, either from a dumpTree output tree or from EdepDump
+class DumpReader {
+
+public:
+  DumpReader( TTree * tree, int first, int n );
+  DumpReader( EdepDump * edep, int first, int n );
+
+  // the distinct GHEP files in the order the events use them, with the range of entries used from each
+  void scan( std::vector<int> &sequence, std::map<int, std::pair<int,int> > &entries );
+
+  // next dump event and its CAF entry number, false when there are no more
+  bool next( DumpEvent &d, int &entry );
+
+  // Keep only part i of n of the input entries. The cuts are moved forward to where the GHEP file changes, so every
+  // GHEP file, and its POT, is in exactly one part. Call before scan().
+  void shard( int i, int n );
+
+  // input entries [first, last) this reader hands out, dump tree or edep-sim
+  int firstEntry() const { return first; }
+  int lastEntry() const { return last; }
+
+  // CAF event numbers: the dump tree entry, which with --edepsim is counted through the vertices of the earlier entries
+  int firstEvent();
+  int nextEvent() { return firstEvent() + nout; }
+
+  // the input files, and the first entry of each with the total at the end
+  void inputs( std::vector<std::string> &files, std::vector<Long64_t> &offsets );
+
+private:
+  int fileAt( int ii ); // GHEP file number of input entry ii
+
+  TTree * tree;
+  EdepDump * edep;
+  DumpEvent cur;
+  int first, last; // input entries [first, last), dump tree or edep-sim
+  int ient; // next input entry
+  int base; // CAF event number of the first vertex of entry first with --edepsim, -1 until counted
+  int nout; // dump events handed out so far
+  std::vector<DumpEvent> pending; // vertices of the current edep-sim entry
+  unsigned int ipending;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef GHEPReader_h
+#define GHEPReader_h
+
+#include "TFile.h"
+#include "TTree.h"
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Hands out GENIE gtrees by GHEP file number for the makeCAF event loop
+// Files stay open in a small LRU pool instead of being reopened on every switch, and the file the worker will
+// need next in its own events is opened, and its first baskets read, on a background thread while the current
+// one is being processed. Each worker thread owns its own reader, so the pool is never shared.
+class GHEPReader {
+
+public:
+  GHEPReader( std::string ghepdir, bool grid, bool isGas, bool fhc, int poolSize = 3, bool prefetch = true );
+  ~GHEPReader();
+
+  // the range of entries the job uses from each GHEP file, for the read cache
+  void setEntryRanges( const std::map<int, std::pair<int,int> > &entries );
+
+  // gtree for this GHEP file, NULL if the file or tree is missing
+  TTree * get( int fileNo );
+
+  // start opening a file the caller will need soon, if it isn't open already; does nothing without prefetching
+  void prefetch( int fileNo );
+
+  std::string path( int fileNo ) const;
+
+  static const long long cacheSize = 30000000; // TTreeCache per open file, bytes
+
+private:
+  struct Entry {
+    int fileNo;
+    TFile * file;
+    TTree * tree;
+    unsigned long lastUse;
+    std::shared_future<void> ready; // valid while a background open is pending
+  };
+
+  void open( Entry * e ) const;
+  void evict();
+
+  std::string ghepdir;
+  bool grid, isGas, fhc;
+  unsigned int poolSize;
+  bool prefetching;
+
+  std::map<int, std::pair<int,int> > entryRange;
+
+  std::map<int, Entry*> pool;
+  unsigned long useCounter;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef GenieRecordReader_h
+#define GenieRecordReader_h
+
+#include "TFile.h"
+#include "TTree.h"
+#include "Ntuple/NtpMCEventRecord.h"
+#include <map>
+#include <string>
+
+// GENIE record for a CAF entry, whichever way makeCAF stored it (see GenieMode in CAF.h)
+// For kGenieRef the GHEP files are opened as needed; ghepdir, if given, replaces the directory part of the
+// stored paths, for reading CAFs somewhere other than where they were made.
+class GenieRecordReader {
+
+public:
+  GenieRecordReader( TFile * cafFile, std::string ghepdir = "" );
+  ~GenieRecordReader();
+
+  // NULL if the record can't be found; owned by the reader, valid until the next call
+  genie::NtpMCEventRecord * get( Long64_t cafEntry );
+
+  int mode() const { return genieMode; }
+
+private:
+  TTree * openGHEP( int fileNo );
+
+  int genieMode;
+  std::string ghepdir;
+  TTree * genie;
+  TTree * genieIdx;
+  std::map<int, std::string> paths;
+
+  genie::NtpMCEventRecord * mcrec;
+  int ghep_file, ghep_entry;
+  Long64_t genie_entry;
+
+  // the one GHEP file kept open for kGenieRef
+  int openFileNo;
+  TFile * ghepFile;
+  TTree * gtree;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef HitAccumulator_h
+#define HitAccumulator_h
+
+#include "TG4Event.h"
+#include <map>
+#include <vector>
+
+struct DumpEvent;
+
+// Per-event hit segment sums for EdepDump
+// Each trajectory's primary is resolved once per event with path compression, and the hit segments are copied
+// into flat arrays with their lengths, collar flags and primary species worked out in straight loops, so the
+// per-vertex sums are one pass over plain arrays. Sums are made in hit order, as dumpTree.py does.
+// One accumulator per EdepDump slot; the arrays are reused from event to event.
+class HitAccumulator {
+
+public:
+  HitAccumulator( const double offset[3], const double collarLo[3], const double collarHi[3], bool isGas );
+
+  // new event: resolve primaries and flatten the gas TPC hits, and the ArgonCube hits for LAr
+  void load( const TG4Event &event );
+
+  // length in the gas TPC of the hits from this primary
+  double tpcLength( int trackId ) const;
+
+  // hadTot, hadCollar, per-species energy (LAr) and fsTrkLen, fsTrkLenPerp (gas) for one vertex
+  void accumulate( int ileptraj, const std::map<int, int> &fsParticleIdx, DumpEvent &d );
+
+  enum Species { kSpLepton, kSpP, kSpN, kSpPip, kSpPim, kSpPi0, kSpOther, kNSpecies };
+
+private:
+  // structure of arrays, one entry per hit segment
+  struct Hits {
+    std::vector<int> primaryId;
+    std::vector<char> isPrimary; // primaryId is a primary particle (no parent)
+    std::vector<char> species;
+    std::vector<char> outside; // start point outside the collar box
+    std::vector<float> edep;
+    std::vector<double> x0, y0, z0, x1, y1, z1; // cm, detector coordinates
+    std::vector<double> len, lenPerp; // lenPerp is in the YZ plane
+    void clear();
+  };
+
+  void resolvePrimaries( const std::vector<TG4Trajectory> &trajs );
+  void addHits( Hits &hits, const std::vector<TG4HitSegment> &segs, const std::vector<TG4Trajectory> &trajs );
+  void finish( Hits &hits );
+
+  double offset[3], collarLo[3], collarHi[3];
+  bool isGas;
+
+  Hits tpc, had; // for gas, everything uses tpc
+  std::vector<int> root; // trajectory -> primary track id
+  std::vector<int> primaryPdg; // trajectory -> pdg of its primary
+  std::vector<int> stack;
+  std::vector<int> fsIdx; // track id -> final state index, for the vertex being summed
+};
+
+#endif
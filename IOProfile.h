@@ -0,0 +1,32 @@
+#ifndef IOProfile_h
+#define IOProfile_h
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include <string>
+#include <vector>
+
+// Output tuning for the CAF trees, chosen by name on the command line
+// compression is set on the file before any branch exists, basket size and auto-flush on each tree
+// a setting of kIOKeep leaves what ROOT would have used
+const int kIOKeep = 0;
+
+struct IOProfile {
+  const char * name;
+  const char * description;
+  int algorithm; // ROOT::ECompressionAlgorithm, with level; kIOKeep for both leaves the file's own compression
+  int level;
+  int basketSize; // bytes per branch buffer
+  Long64_t autoFlush; // ROOT convention: > 0 entries, < 0 bytes
+};
+
+// NULL if there is no profile with this name
+const IOProfile * getIOProfile( std::string name );
+std::vector<std::string> ioProfileNames();
+
+void applyIOProfile( const IOProfile &profile, TFile * file );
+void applyIOProfile( const IOProfile &profile, TTree * tree );
+void applyIOProfile( const IOProfile &profile, TBranch * branch ); // for a branch added after the tree's call
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef RecoKernel_h
+#define RecoKernel_h
+
+#include "Resolution.h"
+#include <vector>
+
+// Structure-of-arrays version of makeCAF's parameterized reconstruction, for a block of events at a time
+// The per-event functions in makeCAF (recoMuonTracker etc.) stay as the reference implementation. Given the
+// same uniforms from the same per-event streams these give the same numbers; makeCAF --check-batch-reco
+// runs both and compares. Each step is a plain loop over arrays, with no calls into the RNG, so the
+// compiler can vectorise most of it.
+
+// which reco an event's lepton gets, the same choice makeCAF's per-event dispatch makes
+enum LeptonKind { kLepNC = 0, kLepMuonTracker = 1, kLepMuonLAr = 2, kLepMuonECAL = 3, kLepMuonExit = 4, kLepElectron = 5 };
+
+const int kLepUniforms = 7; // uniforms each event takes from its lepton stream, enough for any kind
+const int kGasUniforms = 6; // uniforms each gas TPC particle takes from its own stream
+
+struct RecoKernelParams {
+  bool fhc;
+  double trk_muRes, LAr_muRes, ECAL_muRes;
+  double em_const, em_sqrtE;
+  double michelEff;
+  ResolutionFn thetaRes; // angular resolution (mrad) vs kinetic energy
+  double gastpc_B, gastpc_padPitch, gastpc_X0;
+};
+
+// primary leptons of a block of events
+struct LeptonBatch {
+  void resize( int n );
+
+  int n;
+  // inputs
+  std::vector<int> kind, pdg;
+  std::vector<double> E, px, py, pz; // true lepton, GeV
+  std::vector<double> longest_mip;   // cm, for exiting muons
+  std::vector<double> u;             // u[k*n + i] is the k-th uniform of event i
+  // outputs; Ev_reco is left to the caller, which adds the hadronic energy
+  std::vector<double> Elep_reco, theta_reco;
+  std::vector<int> reco_q, reco_numu, reco_nue, reco_nc;
+  std::vector<int> muon_contained, muon_tracker, muon_ecal, muon_exit;
+
+  // scratch: Box-Muller factors of the three normals each event can use
+  std::vector<double> bmr, bmc;
+};
+
+// final-state particles of a block of gas TPC events
+struct GasTrackBatch {
+  void resize( int n );
+
+  int n;
+  // inputs, straight from the dump tree (MeV, cm)
+  std::vector<int> pdg;
+  std::vector<float> px, py, pz, E, trkLen, trkLenPerp;
+  std::vector<double> lep_tx, lep_ty; // true lepton angles of the particle's event, mrad
+  std::vector<double> u;              // u[k*n + i] is the k-th uniform of particle i
+  // outputs
+  std::vector<int> tracked;  // charged track, momentum from curvature
+  std::vector<int> showered; // pi0 or photon, calorimetric energy
+  std::vector<double> ptrue, preco, ereco; // GeV
+  std::vector<int> muon; // muon longer than 1 m, which gives the lepton
+  std::vector<double> Elep_reco, theta_reco; // only for muons
+
+  std::vector<double> bmr, bmc;
+};
+
+void recoLeptons( LeptonBatch &b, const RecoKernelParams &p );
+void recoGasTracks( GasTrackBatch &b, const RecoKernelParams &p );
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef Resolution_h
+#define Resolution_h
+
+#include "CAFRandom.h"
+#include <string>
+#include <vector>
+
+// Compiled detector resolution functions, looked up by name so that the producers can choose them from
+// their command line. Each one is a plain function of true (kinetic) energy in GeV; these replace the TF1
+// formulas, which were interpreted on every call.
+typedef double (*ResolutionFn)( double );
+
+// NULL if there is no function with this name
+ResolutionFn getResolution( std::string name );
+std::vector<std::string> resolutionNames();
+
+// Zero-mean sum of two Gaussians, exp(-x^2/2 core^2) + ratio * exp(-x^2/2 tail^2), truncated to |x| < range.
+// Sampled directly: pick a component with probability proportional to its integral, then draw from it.
+class DoubleGaussian {
+
+public:
+  DoubleGaussian( double core, double tail, double ratio, double range = 1000. );
+  double sample( CAFRandom &rng ) const;
+
+private:
+  double core, tail;
+  double pCore; // probability of the core component
+  double range;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef ReweightStage_h
+#define ReweightStage_h
+
+#include "CAF.h"
+#include "EVGCore/EventRecord.h"
+#include "nusystematics/artless/response_helper.hh"
+#include <string>
+#include <vector>
+
+// DUNErw weights for a batch of events at a time
+// Owns one response_helper per thread; the batch is shared out event by event, each thread taking the next
+// unclaimed event, so a few slow events don't hold up a whole contiguous block.
+// response_helper only gives all parameters of an event together, so events are the unit of work; the
+// parameters of one event always stay on one thread.
+class ReweightStage {
+
+public:
+  ReweightStage( std::string fhicl_filename, int nthreads );
+  ~ReweightStage();
+
+  // the first helper, for the parameter headers when making branches
+  nusyst::response_helper & helper() { return *helpers[0]; }
+
+  // fill nwgt, cvwgt and wgt of cafs[i] from events[i]; NULL events are skipped
+  void process( const std::vector<genie::EventRecord*> &events, const std::vector<CAF*> &cafs );
+
+private:
+  std::vector<nusyst::response_helper*> helpers;
+};
+
+#endif
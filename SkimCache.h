@@ -0,0 +1,44 @@
+#ifndef SkimCache_h
+#define SkimCache_h
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TChain.h"
+#include <string>
+
+// makeCov's cache of selected events
+// A sample's cache is its selected events, with only the branches makeCov reads, in uncompressed ROOT files so
+// reading them back is just I/O. It is keyed by a hash of the input files' names, sizes and modification times
+// and the selection version, so it goes stale by itself when the inputs or the cuts change. The cache for a
+// key is complete once its .done file exists; it lists the inputs.
+
+// bump this whenever a cut changes
+const int kSkimVersion = 1;
+
+// key of a sample: 16 hex digits
+std::string skimKey( TChain * chain, std::string sample );
+
+// the part files of a cache, as a pattern TChain::Add can expand, and the name of part i
+std::string skimPattern( std::string dir, std::string sample, std::string key );
+std::string skimPart( std::string dir, std::string sample, std::string key, int i );
+
+bool skimDone( std::string dir, std::string sample, std::string key );
+// removes the parts left by a run that didn't finish, which may have had more of them
+void clearSkim( std::string dir, std::string sample, std::string key );
+void markSkimDone( std::string dir, std::string sample, std::string key, TChain * chain );
+
+// copies the active branches of the selected entries of in into one part file
+// with an empty path it does nothing, so loops can always call fill()
+class SkimWriter {
+public:
+  SkimWriter( TTree * in, Long64_t first, std::string path );
+  ~SkimWriter();
+
+  void fill() { if( tree ) tree->Fill(); }
+
+private:
+  TFile * file;
+  TTree * tree;
+};
+
+#endif
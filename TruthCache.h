@@ -0,0 +1,68 @@
+#ifndef TruthCache_h
+#define TruthCache_h
+
+#include "TFile.h"
+#include "TTree.h"
+#include "EVGCore/EventRecord.h"
+#include <string>
+#include <vector>
+
+// Flat GENIE truth of one GHEP file, made once by makeTruthCache so that repeat passes don't stream GENIE records
+// It holds what makeCAF and nueElasticCAF take from a record: probe, primary lepton and vertex, the stable
+// final-state particles and the file's POT. The columns are kept like the arrays of a struct: one entry per event in
+// the event columns, and the particles of all the events one after another in the particle columns, event i's from
+// fsBegin[i] to fsBegin[i+1]. On disk it is a flat, uncompressed tree, so reading it back is just I/O.
+
+// bump this whenever a column changes
+const int kTruthVersion = 1;
+
+// the cache file of a GHEP file: its name with .truth.root for .ghep.root, in dir, or next to it if dir is empty
+std::string truthPath( std::string ghepPath, std::string dir = "" );
+
+// appends the paths of a file list, one per line; blank lines and # comments are skipped. false if it can't be opened
+bool readFileList( std::string filename, std::vector<std::string> &files );
+
+class TruthTable {
+public:
+  TruthTable();
+
+  void clear();
+  void add( genie::EventRecord &event );
+  bool fill( TTree * gtree ); // all of a gtree, with its POT
+
+  // false if the file is missing, from another version, or made from a GHEP file that has changed since
+  bool read( std::string filename, std::string ghepPath = "" );
+  bool write( std::string filename, std::string ghepPath ) const;
+
+  Long64_t size() const { return probePdg.size(); }
+
+  double pot;
+
+  // per event
+  std::vector<int> probePdg, scatType, lepPdg; // lepPdg is FSPrimLeptonPdg
+  std::vector<double> nuPx, nuPy, nuPz, nuE; // probe in the lab frame
+  std::vector<double> lepPx, lepPy, lepPz, lepE; // Kine().FSLeptonP4()
+  std::vector<double> vtxX, vtxY, vtxZ, vtxT; // GENIE units, m and s
+  std::vector<Long64_t> fsBegin; // size()+1 entries
+
+  // per stable final-state particle
+  std::vector<int> fsPdg;
+  std::vector<double> fsPx, fsPy, fsPz, fsE;
+};
+
+// the last table a worker read, by GHEP file number, for event loops that go through the files in order
+class TruthFiles {
+public:
+  TruthFiles( std::string dir );
+
+  // NULL if the file has no usable cache
+  const TruthTable * get( int fileNo, std::string ghepPath );
+
+private:
+  std::string dir;
+  int fileNo;
+  bool ok;
+  TruthTable table;
+};
+
+#endif
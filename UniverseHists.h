@@ -0,0 +1,79 @@
+#ifndef UniverseHists_h
+#define UniverseHists_h
+
+#include "TH1.h"
+#include "TH2.h"
+#include <string>
+#include <vector>
+
+// Binning of one axis. find() gives the same bin as TAxis::FindBin: 0 for underflow, n+1 for overflow and NaN.
+// Variable bins are looked up in a table on a grid at least twice as fine as the narrowest bin, which lands on the
+// right bin or one off, instead of a binary search.
+class BinAxis {
+public:
+  BinAxis(); // no axis, the y axis of a 1D histogram
+  BinAxis( int n, const double * edges );
+  BinAxis( int n, double lo, double hi );
+
+  int find( double x ) const;
+  int bins() const { return n; }
+  int cells() const { return ( n ? n+2 : 1 ); }
+
+  int n;
+  bool uniform;
+  std::vector<double> edges;
+
+private:
+  std::vector<int> table;
+  double scale; // table entries per unit of x
+};
+
+inline int BinAxis::find( double x ) const
+{
+  if( n == 0 ) return 0;
+  if( x < edges[0] ) return 0;
+  if( !(x < edges[n]) ) return n+1;
+  if( uniform ) return 1 + int( n*(x - edges[0])/(edges[n] - edges[0]) );
+  unsigned int t = (unsigned int) ((x - edges[0])*scale);
+  if( t >= table.size() ) t = table.size() - 1;
+  int b = table[t];
+  while( b < n && x >= edges[b] ) ++b;
+  while( b > 1 && x < edges[b-1] ) --b;
+  return b;
+}
+
+// The same histogram for a block of universes, in one array laid out [universe][cell]. Cells are numbered like
+// ROOT's global bins, x + (nx+2)*y with the under- and overflows, so a universe exports cell for cell to the TH1D
+// or TH2D that filling it would have made. Only the sums of weights are kept; the exported histograms have
+// sqrt(content) errors, which are right for unit weights.
+class UniverseHists {
+public:
+  UniverseHists();
+
+  // name is a printf pattern for the universe's number in the whole set, like "h%03d"
+  void book( std::string name, std::string title, int firstU, int nU, const BinAxis &x, const BinAxis &y = BinAxis() );
+
+  int cell( double x ) const { return xaxis.find( x ); }
+  int cell( double x, double y ) const { return xaxis.find( x ) + nx2*yaxis.find( y ); }
+  void fill( int u, int c, double w = 1. ) { sumw[u*ncells + c] += w; }
+
+  double content( int u, int bx, int by = 0 ) const { return sumw[u*ncells + bx + nx2*by]; }
+  double projectX( int u, int bx ) const; // summed over y, with the under- and overflow like TH2::ProjectionX
+
+  void add( const UniverseHists &other );
+  void reset();
+
+  std::string histName( int u ) const; // u counts from the start of the block
+  TH1 * make( int u ) const; // not in any directory
+  void read( const TH1 * h, int u ); // adds h to universe u
+
+  int firstU, nU;
+
+private:
+  std::string name, title;
+  BinAxis xaxis, yaxis;
+  int nx2, ncells;
+  std::vector<double> sumw;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef UniverseThrows_h
+#define UniverseThrows_h
+
+#include "TRandom3.h"
+#include "TTree.h"
+#include <math.h>
+#include <vector>
+
+// makeCov's energy-scale throws, with one coefficient per universe in flat arrays
+// Every scale has the form of the TF1s it replaces, c0 + c1*x + c2*f(x), with f(x) = (x+0.1)^-1/2 for the
+// energy scales and x^2 for the gas TPC momentum scale. f(x) of an event is worked out once, so each universe is
+// a few multiply-adds over contiguous arrays, and the loops over universes have no calls in them that would stop
+// the compiler vectorising them.
+struct ScaleThrow {
+  void resize( int nu );
+  void keep( int first, int n );
+  double eval( int u, double x, double fx ) const { return c0[u] + c1[u]*x + c2[u]*fx; }
+
+  std::vector<double> c0, c1, c2;
+};
+
+inline double escaleBasis( double x ) { return pow( x+0.1, -0.5 ); }
+inline double pscaleBasis( double x ) { return pow( x, 2. ); }
+
+// energy scale and resolution throws of one detector
+// mu is the scale of muons contained in LAr, and muGAr the ND one for muons measured in the gas tracker; the FD
+// only uses mu
+struct EscaleThrows {
+  void resize( int nu );
+  void keep( int first, int n ); // only universes first to first+n-1
+
+  int nu;
+  ScaleThrow tot, mu, muGAr, had, em, neut;
+  std::vector<double> muRes, hadRes, emRes, neutRes;
+};
+
+// gas TPC throws
+struct GasThrows {
+  void resize( int nu );
+  void keep( int first, int n );
+
+  int nu;
+  ScaleThrow p; // momentum scale, f(x) = x^2
+  ScaleThrow ecal;
+  std::vector<double> trkThreshold; // track length threshold
+};
+
+// reco and true energies of one selected event, GeV
+struct EscaleEvent {
+  double Ev_reco, Elep_reco, LepE;
+  double eRecoP, eRecoN, eRecoPip, eRecoPim, eRecoPi0;
+  double eP, eN, ePip, ePim, ePi0;
+};
+
+// all the throws, drawn in the order makeCov always drew them so a seed gives the same universes
+void throwUniverses( TRandom3 &rando, EscaleThrows &nd, EscaleThrows &fd, GasThrows &gas );
+
+// writes the throws to the current directory as a tree with one entry per universe; firstU is the number of the first
+void writeThrows( const EscaleThrows &nd, const EscaleThrows &fd, const GasThrows &gas, int firstU );
+
+// shifted lepton and hadronic reco energy of an event in every universe
+// mu is the lepton scale to use; totOnLepton applies the total energy scale to the lepton as well
+void shiftEnergies( const EscaleThrows &t, const ScaleThrow &mu, bool totOnLepton, const EscaleEvent &ev, double * elep, double * ehad );
+
+// shifted reco energy and charged pion multiplicity of a gas TPC event in every universe
+void shiftGas( const GasThrows &t, int nFSP, const int * pdg, const double * trkLen, const double * partEvReco, double * ev, int * pimult );
+
+double getP( double e, int pdg );
+double getE( double p, int pdg );
+
+#endif
@@ -0,0 +1,210 @@
+#include "CAFColumns.C"
+#include "TFile.h"
+#include "TTree.h"
+#include "TLeaf.h"
+#include "TStopwatch.h"
+#include <math.h>
+#include <sys/stat.h>
+#include <sstream>
+
+#ifdef CAF_PARQUET
+#include <arrow/io/file.h>
+#include <parquet/arrow/reader.h>
+#endif
+
+// Compare the caf TTree with its Parquet copy: write time, file size, and the time to scan a few columns
+// Usage: benchCAF --infile CAF.root [--columns Ev_reco,Elep_reco,isCC] [--outdir .]
+
+double fileSize( std::string path )
+{
+  struct stat st;
+  if( stat(path.c_str(), &st) != 0 ) return 0.;
+  return st.st_size;
+}
+
+// sum of the named columns over every entry, reading only those branches
+double scanTree( std::string path, const std::vector<std::string> &names )
+{
+  TFile * tf = new TFile( path.c_str() );
+  TTree * tree = (TTree*) tf->Get( "caf" );
+  tree->SetBranchStatus( "*", 0 );
+  std::vector<TLeaf*> leaves;
+  for( unsigned int i = 0; i < names.size(); ++i ) {
+    tree->SetBranchStatus( names[i].c_str(), 1 );
+    TLeaf * leaf = tree->GetLeaf( names[i].c_str() );
+    if( leaf == NULL ) printf( "No column %s in %s\n", names[i].c_str(), path.c_str() );
+    else {
+      if( leaf->GetLeafCount() ) tree->SetBranchStatus( leaf->GetLeafCount()->GetName(), 1 );
+      leaves.push_back( leaf );
+    }
+  }
+
+  double sum = 0.;
+  Long64_t N = tree->GetEntries();
+  for( Long64_t ii = 0; ii < N; ++ii ) {
+    tree->GetEntry( ii );
+    for( unsigned int i = 0; i < leaves.size(); ++i ) {
+      for( int j = 0; j < leaves[i]->GetLen(); ++j ) sum += leaves[i]->GetValue( j );
+    }
+  }
+  tf->Close();
+  delete tf;
+  return sum;
+}
+
+#ifdef CAF_PARQUET
+template <class A> double sumValues( const arrow::Array &a )
+{
+  const A &arr = (const A&) a;
+  double sum = 0.;
+  for( int64_t i = 0; i < arr.length(); ++i ) sum += arr.Value( i );
+  return sum;
+}
+
+double sumArray( const arrow::Array &a )
+{
+  switch( a.type_id() ) {
+    case arrow::Type::INT32: return sumValues<arrow::Int32Array>( a );
+    case arrow::Type::INT64: return sumValues<arrow::Int64Array>( a );
+    case arrow::Type::UINT16: return sumValues<arrow::UInt16Array>( a );
+    case arrow::Type::FLOAT: return sumValues<arrow::FloatArray>( a );
+    case arrow::Type::DOUBLE: return sumValues<arrow::DoubleArray>( a );
+    case arrow::Type::LIST: {
+      // the flat values of the whole chunk, sliced to the part the offsets use
+      const arrow::ListArray &list = (const arrow::ListArray&) a;
+      if( list.length() == 0 ) return 0.;
+      int first = list.value_offset( 0 );
+      int last = list.value_offset( list.length() );
+      return sumArray( *list.values()->Slice(first, last - first) );
+    }
+    default: return 0.;
+  }
+}
+
+double scanParquet( std::string path, const std::vector<std::string> &names )
+{
+  arrow::Result<std::shared_ptr<arrow::io::ReadableFile> > in = arrow::io::ReadableFile::Open( path );
+  if( !in.ok() ) {
+    printf( "Can't open %s: %s\n", path.c_str(), in.status().ToString().c_str() );
+    return 0.;
+  }
+  std::unique_ptr<parquet::arrow::FileReader> reader;
+  arrow::Status st = parquet::arrow::OpenFile( *in, arrow::default_memory_pool(), &reader );
+  if( !st.ok() ) {
+    printf( "Can't read Parquet from %s: %s\n", path.c_str(), st.ToString().c_str() );
+    return 0.;
+  }
+  std::shared_ptr<arrow::Schema> schema;
+  reader->GetSchema( &schema );
+
+  double sum = 0.;
+  for( unsigned int i = 0; i < names.size(); ++i ) {
+    int idx = schema->GetFieldIndex( names[i] );
+    if( idx < 0 ) {
+      printf( "No column %s in %s\n", names[i].c_str(), path.c_str() );
+      continue;
+    }
+    std::shared_ptr<arrow::ChunkedArray> column;
+    st = reader->ReadColumn( idx, &column );
+    if( !st.ok() ) continue;
+    for( int c = 0; c < column->num_chunks(); ++c ) sum += sumArray( *column->chunk(c) );
+  }
+  return sum;
+}
+#endif
+
+int main( int argc, char const *argv[] )
+{
+  std::string infile;
+  std::string outdir = ".";
+  std::string columnList = "Ev_reco,Elep_reco,isCC";
+
+  int i = 0;
+  while( i < argc ) {
+    if( argv[i] == std::string("--infile") ) {
+      infile = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--outdir") ) {
+      outdir = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--columns") ) {
+      columnList = argv[i+1];
+      i += 2;
+    } else i += 1; // look for next thing
+  }
+
+  std::vector<std::string> names;
+  std::stringstream ss( columnList );
+  std::string name;
+  while( std::getline(ss, name, ',') ) {
+    if( !name.empty() ) names.push_back( name );
+  }
+
+  TFile * tf = new TFile( infile.c_str() );
+  TTree * caf = (TTree*) tf->Get( "caf" );
+  if( caf == NULL ) {
+    printf( "No caf tree in %s\n", infile.c_str() );
+    return 1;
+  }
+  Long64_t N = caf->GetEntries();
+  printf( "Benchmarking %lld entries of %s\n", N, infile.c_str() );
+
+  // reading the input is part of both write tests, so time it on its own too
+  TStopwatch timer;
+  timer.Start();
+  for( Long64_t ii = 0; ii < N; ++ii ) caf->GetEntry( ii );
+  timer.Stop();
+  double tRead = timer.RealTime();
+
+  // TTree write
+  std::string treeOut = outdir + "/bench_caf.root";
+  timer.Start();
+  TFile * fout = new TFile( treeOut.c_str(), "RECREATE" );
+  TTree * copy = caf->CloneTree( 0 );
+  for( Long64_t ii = 0; ii < N; ++ii ) {
+    caf->GetEntry( ii );
+    copy->Fill();
+  }
+  fout->cd();
+  copy->Write();
+  fout->Close();
+  timer.Stop();
+  double tTreeWrite = timer.RealTime() - tRead;
+  delete fout;
+
+#ifdef CAF_PARQUET
+  // Parquet write
+  std::string parquetOut = outdir + "/bench_caf.parquet";
+  timer.Start();
+  CAFColumns columns( caf, parquetOut );
+  for( Long64_t ii = 0; ii < N; ++ii ) {
+    caf->GetEntry( ii );
+    columns.fill();
+  }
+  columns.close();
+  timer.Stop();
+  double tParquetWrite = timer.RealTime() - tRead;
+#endif
+  tf->Close();
+
+  // column scans
+  timer.Start();
+  double sumTree = scanTree( treeOut, names );
+  timer.Stop();
+  double tTreeScan = timer.RealTime();
+
+  printf( "\n%-10s %12s %12s %12s\n", "format", "write (s)", "size (MB)", "scan (s)" );
+  printf( "%-10s %12.3f %12.2f %12.3f\n", "TTree", tTreeWrite, fileSize(treeOut)/1.e6, tTreeScan );
+
+#ifdef CAF_PARQUET
+  timer.Start();
+  double sumParquet = scanParquet( parquetOut, names );
+  timer.Stop();
+  double tParquetScan = timer.RealTime();
+  printf( "%-10s %12.3f %12.2f %12.3f\n", "Parquet", tParquetWrite, fileSize(parquetOut)/1.e6, tParquetScan );
+  printf( "\nColumn sums: TTree %g Parquet %g%s\n", sumTree, sumParquet, (fabs(sumTree - sumParquet) <= 1.e-9*fabs(sumTree) ? "" : "   DIFFERENT!!!") );
+#else
+  printf( "Built without Parquet support (make PARQUET=1), TTree only; column sum %g\n", sumTree );
+#endif
+  printf( "Input read time %.3f s, not included in the write times\n", tRead );
+}
@@ -0,0 +1,55 @@
+#! /usr/bin/env bash
+
+##################################################
+# Regression checks for makeCAF, run on a small input: each pair of jobs must give identical caf trees
+#   ./check_makeCAF.sh DUMP GHEPDIR [NEVENTS] [EDEPDIR FIRST_RUN LAST_RUN]
+# DUMP is a dumpTree output, GHEPDIR the GENIE files it was made from. With the edep-sim runs DUMP was made from,
+# reading them directly with --edepsim is checked against reading DUMP too (all of DUMP, NEVENTS doesn't apply)
+##################################################
+
+DUMP=$1
+GHEPDIR=$2
+NEVENTS=$3
+EDEPDIR=$4
+FIRST_RUN=$5
+LAST_RUN=$6
+if [ "${DUMP}" = "" ] || [ "${GHEPDIR}" = "" ]; then
+echo "Usage: $0 DUMP GHEPDIR [NEVENTS] [EDEPDIR FIRST_RUN LAST_RUN]"
+exit 1
+fi
+
+if [ "${NEVENTS}" = "" ]; then
+NEVENTS=1000
+fi
+
+WORK=$(mktemp -d)
+FAILED=0
+
+# run makeCAF twice with different options and compare every caf branch
+compare() {
+NAME=$1
+OPTS_A=$2
+OPTS_B=$3
+echo "Checking ${NAME}"
+./makeCAF --ghepdir ${GHEPDIR} ${OPTS_A} --outfile ${WORK}/${NAME}_a.root > ${WORK}/${NAME}_a.log 2>&1
+./makeCAF --ghepdir ${GHEPDIR} ${OPTS_B} --outfile ${WORK}/${NAME}_b.root > ${WORK}/${NAME}_b.log 2>&1
+if ./compareCAF --a ${WORK}/${NAME}_a.root --b ${WORK}/${NAME}_b.root --branches "*"; then
+echo "${NAME}: OK"
+else
+echo "${NAME}: FAILED, outputs and logs are in ${WORK}"
+FAILED=1
+fi
+}
+
+# the batch reco kernel against the per-event reference functions
+compare batch_reco "--edepfile ${DUMP} --nevents ${NEVENTS}" "--edepfile ${DUMP} --nevents ${NEVENTS} --reference-reco"
+
+# edep-sim files read directly against the dump tree made from them
+if [ "${EDEPDIR}" != "" ]; then
+compare edepsim "--edepfile ${DUMP}" "--edepsim --edepdir ${EDEPDIR} --first_run ${FIRST_RUN} --last_run ${LAST_RUN}"
+fi
+
+if [ ${FAILED} -eq 0 ]; then
+rm -rf ${WORK}
+fi
+exit ${FAILED}
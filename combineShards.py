@@ -0,0 +1,113 @@
+#!/usr/bin/env python
+
+# Check the shard manifests of a sharded makeCAF production against each other and hadd the shard CAFs
+#   ./combineShards.py --outfile CAF.root CAF_*.manifest.json
+# Every shard must be there once, the shards must read the same inputs, their entry and CAF event ranges must follow
+# on from each other without gaps or overlaps, and every GHEP file must be counted in one shard only. With --check
+# nothing is written.
+
+import sys
+import os.path
+import json
+import subprocess
+from optparse import OptionParser
+
+def check( manifests ):
+
+    ok = True
+    first = manifests[0]
+    nshards = first["nshards"]
+
+    shards = {}
+    for m in manifests:
+        if m["nshards"] != nshards:
+            print("%s is shard %d of %d, but %s is one of %d" % (m["name"], m["shard"], m["nshards"], first["name"], nshards))
+            ok = False
+        if m["input_type"] != first["input_type"]:
+            print("%s read %s input, but %s read %s" % (m["name"], m["input_type"], first["name"], first["input_type"]))
+            ok = False
+        if m["shard"] in shards:
+            print("Shard %d is in both %s and %s" % (m["shard"], shards[m["shard"]]["name"], m["name"]))
+            ok = False
+        shards[m["shard"]] = m
+    for s in range(nshards):
+        if s not in shards:
+            print("Shard %d of %d is missing" % (s, nshards))
+            ok = False
+    if not ok:
+        return False
+
+    # the same input files, split at the same offsets
+    files = [ (i["file"], i["offset"], i["entries"]) for i in first["inputs"] ]
+    for m in manifests:
+        if [ (i["file"], i["offset"], i["entries"]) for i in m["inputs"] ] != files:
+            print("%s and %s read different input files" % (m["name"], first["name"]))
+            ok = False
+    if not ok:
+        return False
+
+    # in shard order the entry ranges, and the CAF event numbers, must follow on from each other
+    ordered = [ shards[s] for s in range(nshards) ]
+    for prev, m in zip(ordered[:-1], ordered[1:]):
+        if m["first"] != prev["last"]:
+            print("%s ends at input entry %d but %s starts at %d" % (prev["name"], prev["last"], m["name"], m["first"]))
+            ok = False
+        if m["event_first"] != prev["event_last"]:
+            print("%s ends at CAF event %d but %s starts at %d" % (prev["name"], prev["event_last"], m["name"], m["event_first"]))
+            ok = False
+
+    # each GHEP file's POT in one shard, and each shard's POT the sum of its files'
+    counted = {}
+    for m in ordered:
+        pot = 0.
+        for g in m["ghep_files"]:
+            if g["file_no"] in counted:
+                print("GHEP file %d (%s) is counted in both %s and %s" % (g["file_no"], g["path"], counted[g["file_no"]], m["name"]))
+                ok = False
+            counted[g["file_no"]] = m["name"]
+            pot += g["pot"]
+        if abs(pot - m["pot"]) > 1.e-9*abs(m["pot"]):
+            print("%s has %g POT, but its GHEP files add up to %g" % (m["name"], m["pot"], pot))
+            ok = False
+
+    print("Input entries %d to %d, CAF events %d to %d" % (ordered[0]["first"], ordered[-1]["last"], ordered[0]["event_first"], ordered[-1]["event_last"]))
+    print("%d shards, %d CAF entries, %d GHEP files, %g POT" % (nshards, sum([ m["events"] for m in ordered ]), len(counted), sum([ m["pot"] for m in ordered ])))
+    return ok
+
+if __name__ == "__main__":
+
+    parser = OptionParser(usage="usage: %prog [options] MANIFEST...")
+    parser.add_option('--outfile', help='Combined CAF file', default=None)
+    parser.add_option('--check', action='store_true', help='Only check the manifests', default=False)
+
+    (args, files) = parser.parse_args()
+    if len(files) == 0 or (args.outfile is None and not args.check):
+        parser.print_help()
+        sys.exit(1)
+
+    manifests = []
+    for fname in files:
+        with open(fname) as f:
+            m = json.load(f)
+        m["name"] = fname
+        manifests.append(m)
+
+    if not check(manifests):
+        print("The shards don't fit together, not combining them")
+        sys.exit(1)
+    if args.check:
+        sys.exit(0)
+
+    # the outputs are named relative to where makeCAF ran, which may not be here
+    outputs = []
+    for m in sorted(manifests, key=lambda m: m["shard"]):
+        out = m["output"]
+        if not os.path.exists(out):
+            out = os.path.join(os.path.dirname(m["name"]), os.path.basename(out))
+        if not os.path.exists(out):
+            print("Can't find %s, the output of %s" % (m["output"], m["name"]))
+            sys.exit(1)
+        outputs.append(out)
+
+    # the meta trees are added up with the rest, so the combined file has the total POT
+    sys.exit(subprocess.call([ "hadd", "-f", args.outfile ] + outputs))
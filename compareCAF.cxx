@@ -0,0 +1,127 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
+#include <fnmatch.h>
+#include <stdio.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Check that two CAF files agree exactly, entry by entry, in the caf branches matching a list of patterns
+// Usage: compareCAF --a CAF_1thread.root --b CAF_8threads.root [--branches "wgt_*,*_cvwgt,*_cvvar,var_*"]
+// With the default patterns this is the reweight check: a job run with --threads 1 and the same job with --threads N
+// must give identical weights. Exits with 1 if anything differs.
+
+// the leaves of tree whose names match one of the patterns, with their counts switched on too
+std::vector<TLeaf*> matchingLeaves( TTree * tree, const std::vector<std::string> &patterns )
+{
+  std::vector<TLeaf*> leaves;
+  tree->SetBranchStatus( "*", 0 );
+  TObjArray * all = tree->GetListOfLeaves();
+  for( int k = 0; k < all->GetEntriesFast(); ++k ) {
+    TLeaf * leaf = (TLeaf*) all->At( k );
+    for( unsigned int p = 0; p < patterns.size(); ++p ) {
+      if( fnmatch(patterns[p].c_str(), leaf->GetName(), 0) != 0 ) continue;
+      tree->SetBranchStatus( leaf->GetName(), 1 );
+      if( leaf->GetLeafCount() ) tree->SetBranchStatus( leaf->GetLeafCount()->GetName(), 1 );
+      leaves.push_back( leaf );
+      break;
+    }
+  }
+  return leaves;
+}
+
+int main( int argc, char const *argv[] )
+{
+  std::string fileA, fileB;
+  std::string branchList = "wgt_*,*_cvwgt,*_cvvar,var_*";
+
+  int i = 1;
+  while( i < argc ) {
+    if( argv[i] == std::string("--a") ) {
+      fileA = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--b") ) {
+      fileB = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--branches") ) {
+      branchList = argv[i+1];
+      i += 2;
+    } else i += 1; // look for next thing
+  }
+
+  std::vector<std::string> patterns;
+  std::stringstream ss( branchList );
+  std::string pattern;
+  while( std::getline(ss, pattern, ',') ) {
+    if( !pattern.empty() ) patterns.push_back( pattern );
+  }
+
+  TFile * fa = new TFile( fileA.c_str() );
+  TFile * fb = new TFile( fileB.c_str() );
+  TTree * ta = ( fa->IsZombie() ? NULL : (TTree*) fa->Get("caf") );
+  TTree * tb = ( fb->IsZombie() ? NULL : (TTree*) fb->Get("caf") );
+  if( ta == NULL || tb == NULL ) {
+    printf( "No caf tree in %s\n", (ta == NULL ? fileA : fileB).c_str() );
+    return 1;
+  }
+
+  // pair the leaves up by name; one that is in only one of the files is a difference by itself
+  std::vector<TLeaf*> allA = matchingLeaves( ta, patterns );
+  std::vector<TLeaf*> allB = matchingLeaves( tb, patterns );
+  std::vector<TLeaf*> la, lb;
+  int differences = 0;
+  for( unsigned int k = 0; k < allA.size(); ++k ) {
+    TLeaf * leaf = tb->GetLeaf( allA[k]->GetName() );
+    if( leaf == NULL ) {
+      printf( "%s is only in %s\n", allA[k]->GetName(), fileA.c_str() );
+      ++differences;
+    } else {
+      la.push_back( allA[k] );
+      lb.push_back( leaf );
+    }
+  }
+  for( unsigned int k = 0; k < allB.size(); ++k ) {
+    if( ta->GetLeaf(allB[k]->GetName()) == NULL ) {
+      printf( "%s is only in %s\n", allB[k]->GetName(), fileB.c_str() );
+      ++differences;
+    }
+  }
+
+  Long64_t N = ta->GetEntries();
+  if( tb->GetEntries() != N ) {
+    printf( "%s has %lld entries, %s has %lld\n", fileA.c_str(), N, fileB.c_str(), tb->GetEntries() );
+    return 1;
+  }
+  printf( "Comparing %lu branches over %lld entries\n", la.size(), N );
+
+  // only the first few differences of each branch are printed
+  std::vector<int> bad( la.size(), 0 );
+  for( Long64_t ii = 0; ii < N; ++ii ) {
+    ta->GetEntry( ii );
+    tb->GetEntry( ii );
+    for( unsigned int k = 0; k < la.size(); ++k ) {
+      int len = la[k]->GetLen();
+      bool same = ( lb[k]->GetLen() == len );
+      for( int j = 0; same && j < len; ++j ) same = ( la[k]->GetValue(j) == lb[k]->GetValue(j) );
+      if( same ) continue;
+      if( bad[k]++ < 5 ) printf( "Entry %lld: %s differs\n", ii, la[k]->GetName() );
+    }
+  }
+
+  for( unsigned int k = 0; k < la.size(); ++k ) {
+    if( bad[k] == 0 ) continue;
+    printf( "%s differs in %d entries\n", la[k]->GetName(), bad[k] );
+    ++differences;
+  }
+  fa->Close();
+  fb->Close();
+
+  if( differences ) {
+    printf( "%d differences\n", differences );
+    return 1;
+  }
+  printf( "Identical\n" );
+  return 0;
+}
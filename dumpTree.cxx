@@ -0,0 +1,179 @@
+#include "EdepDump.C"
+#include "HitAccumulator.C"
+#include "TFile.h"
+#include "TTree.h"
+#include "TROOT.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Compiled dumpTree.py: extract edep-sim output to the flat tree that makeCAF --edepfile reads
+// edep-sim entries are processed in blocks, each cut into contiguous pieces that the worker threads take from a
+// queue, and the block is written in order. The workers live for the whole run, so TGeoManager only ever sees
+// nthreads threads, each with its own navigator.
+
+// one thread's share of the block
+void dumpBlock( EdepDump &edep, std::vector<std::vector<DumpEvent> > &block, int first, int lo, int hi, int slot )
+{
+  for( int i = lo; i < hi; ++i ) {
+    block[i].clear();
+    edep.process( first + i, block[i], slot );
+  }
+}
+
+// pieces of the current block waiting for a worker, and how many are not finished yet
+struct BlockQueue {
+  struct Piece { int first, lo, hi; };
+  std::deque<Piece> pieces;
+  int unfinished;
+  bool quit;
+  std::mutex mutex;
+  std::condition_variable ready, done;
+};
+
+// worker thread t, with edep-sim slot t, until the queue is told to quit
+void dumpWorker( EdepDump * edep, std::vector<std::vector<DumpEvent> > * block, BlockQueue * queue, int slot )
+{
+  while( true ) {
+    BlockQueue::Piece piece;
+    {
+      std::unique_lock<std::mutex> lock( queue->mutex );
+      queue->ready.wait( lock, [queue]{ return queue->quit || !queue->pieces.empty(); } );
+      if( queue->pieces.empty() ) return;
+      piece = queue->pieces.front();
+      queue->pieces.pop_front();
+    }
+    dumpBlock( *edep, *block, piece.first, piece.lo, piece.hi, slot );
+    {
+      std::lock_guard<std::mutex> lock( queue->mutex );
+      if( --queue->unfinished == 0 ) queue->done.notify_one();
+    }
+  }
+}
+
+int main( int argc, char const *argv[] )
+{
+  std::string outfile = "out.root";
+  std::string topdir = "";
+  int first_run = 0;
+  int last_run = 0;
+  bool rhc = false;
+  bool grid = false;
+  bool isGas = false;
+  int nthreads = 1;
+  int batch = 64; // entries per thread per block
+
+  int i = 0;
+  while( i < argc ) {
+    if( argv[i] == std::string("--outfile") ) {
+      outfile = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--topdir") ) {
+      topdir = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--first_run") ) {
+      first_run = atoi(argv[i+1]);
+      i += 2;
+    } else if( argv[i] == std::string("--last_run") ) {
+      last_run = atoi(argv[i+1]);
+      i += 2;
+    } else if( argv[i] == std::string("--threads") ) {
+      nthreads = atoi(argv[i+1]);
+      i += 2;
+    } else if( argv[i] == std::string("--rhc") ) {
+      rhc = true;
+      i += 1;
+    } else if( argv[i] == std::string("--grid") ) {
+      grid = true;
+      i += 1;
+    } else if( argv[i] == std::string("--gastpc") ) {
+      isGas = true;
+      i += 1;
+    } else i += 1; // look for next thing
+  }
+  if( nthreads < 1 ) nthreads = 1;
+  if( nthreads > 1 ) ROOT::EnableThreadSafety();
+
+  // make an output ntuple
+  TFile * fout = new TFile( outfile.c_str(), "RECREATE" );
+  TTree * tout = new TTree( "tree", "tree" );
+  DumpEvent d;
+  tout->Branch( "ifileNo", &d.ifileNo, "ifileNo/I" );
+  tout->Branch( "ievt", &d.ievt, "ievt/I" );
+  tout->Branch( "p3lep", d.p3lep, "p3lep[3]/F" );
+  tout->Branch( "vtx", d.vtx, "vtx[3]/F" );
+  tout->Branch( "lepDeath", d.lepDeath, "lepDeath[3]/F" );
+  tout->Branch( "lepPdg", &d.lepPdg, "lepPdg/I" );
+  tout->Branch( "lepKE", &d.lepKE, "lepKE/F" );
+  tout->Branch( "muonExitPt", d.muonExitPt, "muonExitPt[3]/F" );
+  tout->Branch( "muonExitMom", d.muonExitMom, "muonExitMom[3]/F" );
+  tout->Branch( "muonReco", &d.muonReco, "muonReco/I" );
+  tout->Branch( "muGArLen", &d.muGArLen, "muGArLen/F" );
+  tout->Branch( "hadTot", &d.hadTot, "hadTot/F" );
+  if( !isGas ) {
+    tout->Branch( "hadP", &d.hadP, "hadP/F" );
+    tout->Branch( "hadN", &d.hadN, "hadN/F" );
+    tout->Branch( "hadPip", &d.hadPip, "hadPip/F" );
+    tout->Branch( "hadPim", &d.hadPim, "hadPim/F" );
+    tout->Branch( "hadPi0", &d.hadPi0, "hadPi0/F" );
+    tout->Branch( "hadOther", &d.hadOther, "hadOther/F" );
+  }
+  tout->Branch( "hadCollar", &d.hadCollar, "hadCollar/F" );
+  tout->Branch( "nFS", &d.nFS, "nFS/I" );
+  tout->Branch( "fsPdg", d.fsPdg, "fsPdg[nFS]/I" );
+  tout->Branch( "fsPx", d.fsPx, "fsPx[nFS]/F" );
+  tout->Branch( "fsPy", d.fsPy, "fsPy[nFS]/F" );
+  tout->Branch( "fsPz", d.fsPz, "fsPz[nFS]/F" );
+  tout->Branch( "fsE", d.fsE, "fsE[nFS]/F" );
+  tout->Branch( "fsTrkLen", d.fsTrkLen, "fsTrkLen[nFS]/F" );
+  if( isGas ) tout->Branch( "fsTrkLenPerp", d.fsTrkLenPerp, "fsTrkLenPerp[nFS]/F" );
+
+  EdepDump edep( topdir, first_run, last_run, rhc, grid, isGas, nthreads );
+  int N = edep.entries();
+
+  printf( "Starting loop over %d entries with %d threads\n", N, nthreads );
+  std::vector<std::vector<DumpEvent> > block( nthreads * batch );
+  BlockQueue queue;
+  queue.unfinished = 0;
+  queue.quit = false;
+  std::vector<std::thread> threads;
+  for( int t = 0; t < nthreads && nthreads > 1; ++t ) threads.push_back( std::thread(dumpWorker, &edep, &block, &queue, t) );
+
+  for( int first = 0; first < N; first += (int) block.size() ) {
+    int nblock = std::min( (int) block.size(), N - first );
+    printf( "Event %d of %d...\n", first, N );
+
+    if( nthreads == 1 ) dumpBlock( edep, block, first, 0, nblock, 0 );
+    else {
+      std::unique_lock<std::mutex> lock( queue.mutex );
+      for( int t = 0; t < nthreads; ++t ) {
+        BlockQueue::Piece piece = { first, nblock * t / nthreads, nblock * (t+1) / nthreads };
+        queue.pieces.push_back( piece );
+      }
+      queue.unfinished = nthreads;
+      queue.ready.notify_all();
+      queue.done.wait( lock, [&queue]{ return queue.unfinished == 0; } );
+    }
+
+    for( int b = 0; b < nblock; ++b ) {
+      for( unsigned int v = 0; v < block[b].size(); ++v ) {
+        d = block[b][v];
+        tout->Fill();
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( queue.mutex );
+    queue.quit = true;
+  }
+  queue.ready.notify_all();
+  for( unsigned int t = 0; t < threads.size(); ++t ) threads[t].join();
+
+  fout->cd();
+  tout->Write();
+  fout->Close();
+
+  printf( "-30-\n" );
+}
@@ -1,23 +1,49 @@
 #include "CAF.C"
-#include "TRandom3.h"
+#include "CAFColumns.C"
+#include "IOProfile.C"
+#include "CAFRandom.C"
+#include "GHEPReader.C"
+#include "TruthCache.C"
+#include "ReweightStage.C"
+#include "RecoKernel.C"
+#include "Resolution.C"
+#include "EdepDump.C"
+#include "HitAccumulator.C"
 #include "TFile.h"
 #include "TTree.h"
 #include "TVector3.h"
 #include "TLorentzVector.h"
 #include "Ntuple/NtpMCEventRecord.h"
 #include "EVGCore/EventRecord.h"
-#include "nusystematics/artless/response_helper.hh"
+#include "TROOT.h"
 #include <stdio.h>
+#include <glob.h>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
 
-TRandom3 * rando;
 const double mmu = 0.1056583745;
-TF1 * tsmear; // angular resolution function
+ResolutionFn thetaRes; // angular resolution (mrad) vs kinetic energy, chosen by name with --theta-res
+
+// independent random streams within one event, so one smearing step never shifts the numbers another one sees
+enum RandomStream { kLeptonReco = 0, kPi0 = 1, kChargeConfusion = 2, kPileup = 3, kGasTPC = 0x100 /* + FS particle index */ };
 
 // params will be extracted from command line, and passed to the reconstruction
 struct params {
   double OA_xcoord;
   bool fhc, grid, IsGasTPC;
   int seed, run, subrun, first, n, nfiles;
+  int nthreads, batch;
+  int write_queue;
+  int ghep_pool;
+  int wgt_precision;
+  int genie_mode;
+  bool batch_reco, check_reco;
+  std::string theta_res;
+  bool prefetch;
+  std::string truth_cache; // directory of makeTruthCache tables, empty to read the GENIE records
   double trk_muRes, LAr_muRes, ECAL_muRes;
   double em_const, em_sqrtE;
   double michelEff;
@@ -27,19 +53,19 @@ struct params {
 };
 
 // Fill reco variables for muon reconstructed in magnetized tracker
-void recoMuonTracker( CAF &caf, params &par )
+void recoMuonTracker( CAF &caf, params &par, CAFRandom &rng )
 {
   // smear momentum by resolution
   double p = sqrt(caf.LepE*caf.LepE - mmu*mmu);
-  double reco_p = rando->Gaus( p, p*par.trk_muRes );
+  double reco_p = rng.Gaus( p, p*par.trk_muRes );
   caf.Elep_reco = sqrt(reco_p*reco_p + mmu*mmu);
 
   double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
   double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
-  double evalTsmear = tsmear->Eval(caf.Elep_reco - mmu);
+  double evalTsmear = thetaRes(caf.Elep_reco - mmu);
   if( evalTsmear < 0. ) evalTsmear = 0.;
-  double reco_tx = true_tx + rando->Gaus(0., evalTsmear/sqrt(2.));
-  double reco_ty = true_ty + rando->Gaus(0., evalTsmear/sqrt(2.));
+  double reco_tx = true_tx + rng.Gaus(0., evalTsmear/sqrt(2.));
+  double reco_ty = true_ty + rng.Gaus(0., evalTsmear/sqrt(2.));
   caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
 
   // assume perfect charge reconstruction
@@ -52,26 +78,26 @@ void recoMuonTracker( CAF &caf, params &par )
 }
 
 // Fill reco muon variables for muon contained in LAr
-void recoMuonLAr( CAF &caf, params &par )
+void recoMuonLAr( CAF &caf, params &par, CAFRandom &rng )
 {
   // range-based, smear kinetic energy
   double ke = caf.LepE - mmu;
-  double reco_ke = rando->Gaus( ke, ke*par.LAr_muRes );
+  double reco_ke = rng.Gaus( ke, ke*par.LAr_muRes );
   caf.Elep_reco = reco_ke + mmu;
 
   double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
   double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
-  double evalTsmear = tsmear->Eval(caf.Elep_reco - mmu);
+  double evalTsmear = thetaRes(caf.Elep_reco - mmu);
   if( evalTsmear < 0. ) evalTsmear = 0.;
-  double reco_tx = true_tx + rando->Gaus(0., evalTsmear/sqrt(2.));
-  double reco_ty = true_ty + rando->Gaus(0., evalTsmear/sqrt(2.));
+  double reco_tx = true_tx + rng.Gaus(0., evalTsmear/sqrt(2.));
+  double reco_ty = true_ty + rng.Gaus(0., evalTsmear/sqrt(2.));
   caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
 
 
   // assume negative for FHC, require Michel for RHC
   if( par.fhc ) caf.reco_q = -1;
   else {
-    double michel = rando->Rndm();
+    double michel = rng.Rndm();
     if( caf.LepPDG == -13 && michel < par.michelEff ) caf.reco_q = 1; // correct mu+
     else if( caf.LepPDG == 13 && michel < par.michelEff*0.25 ) caf.reco_q = 1; // incorrect mu-
     else caf.reco_q = -1; // no reco Michel
@@ -83,19 +109,19 @@ void recoMuonLAr( CAF &caf, params &par )
 }
 
 // Fill reco variables for muon reconstructed in magnetized tracker
-void recoMuonECAL( CAF &caf, params &par )
+void recoMuonECAL( CAF &caf, params &par, CAFRandom &rng )
 {
   // range-based KE
   double ke = caf.LepE - mmu;
-  double reco_ke = rando->Gaus( ke, ke*par.ECAL_muRes );
+  double reco_ke = rng.Gaus( ke, ke*par.ECAL_muRes );
   caf.Elep_reco = reco_ke + mmu;
 
   double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
   double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
-  double evalTsmear = tsmear->Eval(caf.Elep_reco - mmu);
+  double evalTsmear = thetaRes(caf.Elep_reco - mmu);
   if( evalTsmear < 0. ) evalTsmear = 0.;
-  double reco_tx = true_tx + rando->Gaus(0., evalTsmear/sqrt(2.));
-  double reco_ty = true_ty + rando->Gaus(0., evalTsmear/sqrt(2.));
+  double reco_tx = true_tx + rng.Gaus(0., evalTsmear/sqrt(2.));
+  double reco_ty = true_ty + rng.Gaus(0., evalTsmear/sqrt(2.));
   caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
 
   // assume perfect charge reconstruction -- these are fairly soft and should curve a lot in short distance
@@ -108,41 +134,41 @@ void recoMuonECAL( CAF &caf, params &par )
 }
 
 // Fill reco variables for true electron
-void recoElectron( CAF &caf, params &par )
+void recoElectron( CAF &caf, params &par, CAFRandom &rng )
 {
   caf.reco_q = 0; // never know charge
   caf.reco_numu = 0;
   caf.muon_contained = 0; caf.muon_tracker = 1; caf.muon_ecal = 0; caf.muon_exit = 0;
 
   // fake efficiency...threshold of 300 MeV, eff rising to 100% by 700 MeV
-  if( rando->Rndm() > (caf.LepE-0.3)*2.5 ) { // reco as NC
+  if( rng.Rndm() > (caf.LepE-0.3)*2.5 ) { // reco as NC
     caf.Elep_reco = 0.;
     caf.reco_nue = 0; caf.reco_nc = 1;
     caf.Ev_reco = caf.LepE; // include electron energy in Ev anyway, since it won't show up in reco hadronic energy
   } else { // reco as CC
-    caf.Elep_reco = rando->Gaus( caf.LepE, caf.LepE*(par.em_const + par.em_sqrtE/sqrt(caf.LepE)) );
+    caf.Elep_reco = rng.Gaus( caf.LepE, caf.LepE*(par.em_const + par.em_sqrtE/sqrt(caf.LepE)) );
     caf.reco_nue = 1; caf.reco_nc = 0;
     caf.Ev_reco = caf.Elep_reco;
   }
 
   double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
   double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
-  double evalTsmear = 3. + tsmear->Eval(caf.Elep_reco - mmu);
+  double evalTsmear = 3. + thetaRes(caf.Elep_reco - mmu);
   if( evalTsmear < 0. ) evalTsmear = 0.;
-  double reco_tx = true_tx + rando->Gaus(0., evalTsmear/sqrt(2.));
-  double reco_ty = true_ty + rando->Gaus(0., evalTsmear/sqrt(2.));
+  double reco_tx = true_tx + rng.Gaus(0., evalTsmear/sqrt(2.));
+  double reco_ty = true_ty + rng.Gaus(0., evalTsmear/sqrt(2.));
   caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
 
 }
 
-void decayPi0( TLorentzVector pi0, TVector3 &gamma1, TVector3 &gamma2 )
+void decayPi0( TLorentzVector pi0, TVector3 &gamma1, TVector3 &gamma2, CAFRandom &rng )
 {
   double e = pi0.E();
   double mp = 134.9766; // pi0 mass
 
   double beta = sqrt( 1. - (mp*mp)/(e*e) ); // velocity of pi0
-  double theta = 3.1416*rando->Rndm(); // theta of gamma1 w.r.t. pi0 direction
-  double phi = 2.*3.1416*rando->Rndm(); // phi of gamma1 w.r.t. pi0 direction
+  double theta = 3.1416*rng.Rndm(); // theta of gamma1 w.r.t. pi0 direction
+  double phi = 2.*3.1416*rng.Rndm(); // phi of gamma1 w.r.t. pi0 direction
 
   double p = mp/2.; // photon momentum in pi0 rest frame
   TLorentzVector g1( 0., 0., p, p ); // pre-rotation photon 1
@@ -173,379 +199,779 @@ void decayPi0( TLorentzVector pi0, TVector3 &gamma1, TVector3 &gamma2 )
   gamma2.RotateUz( pi0dir );
 }
 
-// main loop function
-void loop( CAF &caf, params &par, TTree * tree, std::string ghepdir, std::string fhicl_filename )
+// reference per-event reconstruction of the primary lepton, LAr
+// the batch kernel in RecoKernel must agree with this
+void recoLepton( CAF &caf, params &par, CAFRandom &rng, int lepPdg, int muonReco, double longest_mip )
 {
-  // read in edep-sim output file
-  int ifileNo, ievt, lepPdg, muonReco, nFS;
-  float lepKE, muGArLen, hadTot, hadCollar;
-  float hadP, hadN, hadPip, hadPim, hadPi0, hadOther;
-  float p3lep[3], vtx[3], muonExitPt[3], muonExitMom[3];
-  int fsPdg[100];
-  float fsPx[100], fsPy[100], fsPz[100], fsE[100], fsTrkLen[100], fsTrkLenPerp[100];
-  tree->SetBranchAddress( "ifileNo", &ifileNo );
-  tree->SetBranchAddress( "ievt", &ievt );
-  tree->SetBranchAddress( "lepPdg", &lepPdg );
-  tree->SetBranchAddress( "muonReco", &muonReco );
-  tree->SetBranchAddress( "lepKE", &lepKE );
-  tree->SetBranchAddress( "muGArLen", &muGArLen );
-  tree->SetBranchAddress( "hadTot", &hadTot );
-  tree->SetBranchAddress( "hadCollar", &hadCollar );
-  tree->SetBranchAddress( "hadP", &hadP );
-  tree->SetBranchAddress( "hadN", &hadN );
-  tree->SetBranchAddress( "hadPip", &hadPip );
-  tree->SetBranchAddress( "hadPim", &hadPim );
-  tree->SetBranchAddress( "hadPi0", &hadPi0 );
-  tree->SetBranchAddress( "hadOther", &hadOther );
-  tree->SetBranchAddress( "p3lep", p3lep );
-  tree->SetBranchAddress( "vtx", vtx );
-  tree->SetBranchAddress( "muonExitPt", muonExitPt );
-  tree->SetBranchAddress( "muonExitMom", muonExitMom );
-  tree->SetBranchAddress( "nFS", &nFS );
-  tree->SetBranchAddress( "fsPdg", fsPdg );
-  tree->SetBranchAddress( "fsPx", fsPx );
-  tree->SetBranchAddress( "fsPy", fsPy );
-  tree->SetBranchAddress( "fsPz", fsPz );
-  tree->SetBranchAddress( "fsE", fsE );
-  tree->SetBranchAddress( "fsTrkLen", fsTrkLen );
-  tree->SetBranchAddress( "fsTrkLenPerp", fsTrkLenPerp );
-
-  // Get GHEP file for genie::EventRecord from other file
-  int current_file = -1;
-  TFile * ghep_file = NULL;
-  TTree * gtree = NULL;
-
-  std::string mode = ( par.fhc ? "neutrino" : "antineutrino" );
-
-  // DUNE reweight getter
-  nusyst::response_helper rh( fhicl_filename );
-  // Get list of variations, and make CAF branch for each one
-  std::vector<unsigned int> parIds = rh.GetParameters();
-  for( unsigned int i = 0; i < parIds.size(); ++i ) {
-    systtools::SystParamHeader head = rh.GetHeader(parIds[i]);
-    printf( "Adding reweight branch %u for %s with %lu shifts\n", parIds[i], head.prettyName.c_str(), head.paramVariations.size() );
-    bool is_wgt = head.isWeightSystematicVariation;
-    std::string wgt_var = ( is_wgt ? "wgt" : "var" );
-    caf.addRWbranch( parIds[i], head.prettyName, wgt_var, head.paramVariations );
-    caf.iswgt[parIds[i]] = is_wgt;
+  // True CC reconstruction
+  if( abs(lepPdg) == 11 ) { // true nu_e
+    recoElectron( caf, par, rng );
+  } else if( abs(lepPdg) == 13 ) { // true nu_mu
+    if     ( muonReco == 2 ) recoMuonTracker( caf, par, rng ); // gas TPC match
+    else if( muonReco == 1 ) recoMuonLAr( caf, par, rng ); // LAr-contained muon, this might get updated to NC...
+    else if( muonReco == 3 ) recoMuonECAL( caf, par, rng ); // ECAL-stopper
+    else { // exiting but poorly-reconstructed muon
+      caf.Elep_reco = longest_mip * 0.0022;
+      caf.reco_q = 0;
+      caf.reco_numu = 1; caf.reco_nue = 0; caf.reco_nc = 0;
+      caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 1;
+
+      double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
+      double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
+      double evalTsmear = thetaRes(caf.Elep_reco - mmu);
+      if( evalTsmear < 0. ) evalTsmear = 0.;
+      double reco_tx = true_tx + rng.Gaus(0., evalTsmear/sqrt(2.));
+      double reco_ty = true_ty + rng.Gaus(0., evalTsmear/sqrt(2.));
+      caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
+    }
+  } else { // NC -- set PID variables, will get updated later if fake CC
+    caf.Elep_reco = 0.;
+    caf.reco_q = 0;
+    caf.reco_numu = 0; caf.reco_nue = 0; caf.reco_nc = 1;
+    caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
   }
+}
 
-  caf.pot = 0.;
-
-  // Main event loop
-  int N = tree->GetEntries();
-  if( par.n > 0 && par.n < N ) N = par.n + par.first;
-  for( int ii = par.first; ii < N; ++ii ) {
-
-    tree->GetEntry(ii);
-    if( ii % 100 == 0 ) printf( "Event %d of %d...\n", ii, N );
-
-    caf.setToBS();
-
-    // set defaults
-    for( int j = 0; j < 100; ++j ) {
-      caf.nwgt[j] = 7;
-      caf.cvwgt[j] = ( caf.iswgt[j] ? 1. : 0. );
-      for( unsigned int k = 0; k < 100; ++k ) {
-        caf.wgt[j][k] = ( caf.iswgt[j] ? 1. : 0. );
+// reference per-event gas TPC reconstruction
+// the batch kernel in RecoKernel must agree with this
+void recoGasTPC( CAF &caf, const DumpEvent &d, params &par, int entry )
+{
+  const int nFS = d.nFS;
+  const int * fsPdg = d.fsPdg;
+  const float * fsPx = d.fsPx;
+  const float * fsPy = d.fsPy;
+  const float * fsPz = d.fsPz;
+  const float * fsE = d.fsE;
+  const float * fsTrkLen = d.fsTrkLen;
+  const float * fsTrkLenPerp = d.fsTrkLenPerp;
+
+  // gas TPC: FS particle loop look for long enough tracks and smear momenta
+  caf.Ev_reco = 0.;
+  caf.nFSP = nFS;
+  for( int i = 0; i < nFS; ++i ) {
+    CAFRandom rngGas( par.seed, par.run, par.subrun, entry, kGasTPC + i );
+    double ptrue = 0.001*sqrt(fsPx[i]*fsPx[i] + fsPy[i]*fsPy[i] + fsPz[i]*fsPz[i]);
+    double mass = 0.001*sqrt(fsE[i]*fsE[i] - fsPx[i]*fsPx[i] - fsPy[i]*fsPy[i] - fsPz[i]*fsPz[i]);
+    caf.pdg[i] = fsPdg[i];
+    caf.ptrue[i] = ptrue;
+    caf.trkLen[i] = fsTrkLen[i];
+    caf.trkLenPerp[i] = fsTrkLenPerp[i];
+    // track length cut 6cm according to T Junk
+    if( fsTrkLen[i] > 0. && fsPdg[i] != 2112 ) { // basically select charged particles; somehow neutrons ocasionally get nonzero track length
+      double pT = 0.001*sqrt(fsPy[i]*fsPy[i] + fsPz[i]*fsPz[i]); // transverse to B field, in GeV
+      double nHits = fsTrkLen[i] / par.gastpc_padPitch; // doesn't matter if not integer as only used in eq
+      // Gluckstern formula, sigmapT/pT, with sigmaX and L in meters
+      double fracSig_meas = sqrt(720./(nHits+4)) * (0.01*par.gastpc_padPitch/sqrt(12.)) * pT / (0.3 * par.gastpc_B * 0.0001 * fsTrkLenPerp[i]*fsTrkLenPerp[i]);
+      // multiple scattering term
+      double fracSig_MCS = 0.052 / (par.gastpc_B * sqrt(par.gastpc_X0*fsTrkLenPerp[i]*0.0001));
+
+      double sigmaP = ptrue * sqrt( fracSig_meas*fracSig_meas + fracSig_MCS*fracSig_MCS );
+      double preco = rngGas.Gaus( ptrue, sigmaP );
+      double ereco = sqrt( preco*preco + mass*mass ) - mass; // kinetic energy
+      if( abs(fsPdg[i]) == 211 ) ereco += mass; // add pion mass
+      else if( fsPdg[i] == 2212 && preco > 1.5 ) ereco += 0.1395; // mistake pion mass for high-energy proton
+      caf.partEvReco[i] = ereco;
+
+      // threshold cut
+      if( fsTrkLen[i] > par.gastpc_len ) {
+        caf.Ev_reco += ereco;
+        if( fsPdg[i] == 211 || (fsPdg[i] == 2212 && preco > 1.5) ) caf.gastpc_pi_pl_mult++;
+        else if( fsPdg[i] == -211 ) caf.gastpc_pi_min_mult++;
       }
-    }
 
-    // make sure ghep file matches the current one, otherwise update to the current ghep file
-    if( ifileNo != current_file ) {
-      // close the previous file
-      if( ghep_file ) ghep_file->Close();
-
-      if( par.grid ) ghep_file = new TFile( Form("genie.%d.root", ifileNo) );
-      else if( !par.IsGasTPC ) ghep_file = new TFile( Form("%s/%02d/LAr.%s.%d.ghep.root", ghepdir.c_str(), ifileNo/1000, mode.c_str(), ifileNo) );
-      else ghep_file = new TFile( Form("%s/%02d/GAr.%s.%d.ghep.root", ghepdir.c_str(), ifileNo/1000, mode.c_str(), ifileNo) );
-      
-      gtree = (TTree*) ghep_file->Get( "gtree" );
-      caf.pot += gtree->GetWeight();
-      printf( "New GHEP file with %g POT, total = %g\n", gtree->GetWeight(), caf.pot );
-
-      // can't find GHepRecord
-      if( gtree == NULL ) {
-        printf( "Can't find ghep event record for file %d!!!\n", ifileNo );
-        continue;
+      if( (fsPdg[i] == 13 || fsPdg[i] == -13) && fsTrkLen[i] > 100. ) { // muon, don't really care about nu_e CC for now
+        caf.Elep_reco = sqrt(preco*preco + mass*mass);
+        // angle reconstruction
+        double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
+        double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
+        double evalTsmear = thetaRes(caf.Elep_reco - mmu);
+        if( evalTsmear < 0. ) evalTsmear = 0.;
+        double reco_tx = true_tx + rngGas.Gaus(0., evalTsmear/sqrt(2.));
+        double reco_ty = true_ty + rngGas.Gaus(0., evalTsmear/sqrt(2.));
+        caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
+        // assume perfect charge reconstruction
+        caf.reco_q = (fsPdg[i] > 0 ? -1 : 1);
+        caf.reco_numu = 1; caf.reco_nue = 0; caf.reco_nc = 0;
+        caf.muon_tracker = 1;
       }
-
-      gtree->SetBranchAddress( "gmcrec", &caf.mcrec );
-      current_file = ifileNo;
+    } else if( fsPdg[i] == 111 || fsPdg[i] == 22 ) {
+      double ereco = 0.001 * rngGas.Gaus( fsE[i], 0.1*fsE[i] );
+      caf.partEvReco[i] = ereco;
+      caf.Ev_reco += ereco;
     }
+  }
+}
 
-    caf.vtx_x = vtx[0];
-    caf.vtx_y = vtx[1];
-    caf.vtx_z = vtx[2]; 
-    caf.det_x = par.OA_xcoord;
+// what the LAr final-state scan leaves for the lepton reco and the CC/NC confusion
+struct FSScan {
+  double longest_mip, longest_mip_KE;
+  int longest_mip_charge;
+  int electrons;
+  double electron_energy;
+  int reco_electron_pdg;
+};
 
-    // configuration variables in CAF file; we don't use mvaresult so just set it to zero
-    caf.run = par.run;
-    caf.subrun = par.subrun;
-    caf.event = ii;
-    caf.isFD = 0;
-    caf.isFHC = par.fhc;
+// an event in flight: the dump tree input, the CAF buffer a worker fills, and what the writer needs for POT accounting
+struct EventSlot {
+  int entry; // dump tree entry, the same with --edepsim; also the CAF event number
+  DumpEvent in;
+  CAF out;
+  FSScan scan;
+  bool ok;
+  double ghep_pot;
+};
 
-    // get GENIE event record
+// everything one worker thread owns, so that no two threads ever share a GHEP file
+// random numbers come from per-event CAFRandom streams, so there is no RNG state to own
+struct Worker {
+  GHEPReader * ghep;
+  TruthFiles * truth; // NULL without --truth-cache
+  int current_file;
+  LeptonBatch leptons; // batch reco buffers, reused from block to block
+  GasTrackBatch tracks;
+  CAF * check; // scratch event for --check-batch-reco
+  int mismatches;
+};
+
+// Truth and parameterized reconstruction for one event, filled into slot.out
+// This runs on a worker thread, so it must only use the worker's own GHEP files
+void processEvent( EventSlot &slot, Worker &w, params &par )
+{
+  CAF &caf = slot.out;
+  const DumpEvent &d = slot.in;
+  const int ifileNo = d.ifileNo, ievt = d.ievt, lepPdg = d.lepPdg, nFS = d.nFS;
+  const float * vtx = d.vtx;
+  const int * fsPdg = d.fsPdg;
+  const float * fsPx = d.fsPx;
+  const float * fsPy = d.fsPy;
+  const float * fsPz = d.fsPz;
+  const float * fsE = d.fsE;
+  const float * fsTrkLen = d.fsTrkLen;
+
+  slot.ok = false;
+
+  // counter-based random streams keyed on (seed, run, subrun, event), so this event can be reproduced on its own
+  CAFRandom rngPi0( par.seed, par.run, par.subrun, slot.entry, kPi0 );
+
+  caf.setToBS(); // also sets the reweight defaults
+
+  // truth table of this event's ghep file if there is one, otherwise the file itself from the worker's pool of open files
+  const TruthTable * truth = ( w.truth ? w.truth->get(ifileNo, w.ghep->path(ifileNo)) : NULL );
+  TTree * gtree = ( truth ? NULL : w.ghep->get(ifileNo) );
+  if( truth == NULL && gtree == NULL ) {
+    // can't find GHepRecord; only complain once per file
+    if( ifileNo != w.current_file ) printf( "Can't find ghep event record for file %d!!!\n", ifileNo );
+    w.current_file = ifileNo;
+    return;
+  }
+  w.current_file = ifileNo;
+  slot.ghep_pot = ( truth ? truth->pot : gtree->GetWeight() );
+
+  caf.vtx_x = vtx[0];
+  caf.vtx_y = vtx[1];
+  caf.vtx_z = vtx[2]; 
+  caf.det_x = par.OA_xcoord;
+
+  // configuration variables in CAF file; we don't use mvaresult so just set it to zero
+  caf.run = par.run;
+  caf.subrun = par.subrun;
+  caf.event = slot.entry;
+  caf.isFD = 0;
+  caf.isFHC = par.fhc;
+
+  TLorentzVector lepP4;
+  TLorentzVector nuP4;
+  if( truth ) {
+    caf.neutrinoPDG = truth->probePdg[ievt];
+    caf.mode = truth->scatType[ievt];
+    caf.Ev = truth->nuE[ievt];
+    caf.LepPDG = truth->lepPdg[ievt];
+    nuP4.SetPxPyPzE( truth->nuPx[ievt], truth->nuPy[ievt], truth->nuPz[ievt], truth->nuE[ievt] );
+  } else {
+    // get GENIE event record, into this slot's own record so it can still be written out after the worker moves on
+    // the record is the slot's, not the branch's, so neither another slot nor closing the file can delete it
+    caf.mcrec->Clear();
+    gtree->SetBranchAddress( "gmcrec", &caf.mcrec );
     gtree->GetEntry( ievt );
     genie::EventRecord * event = caf.mcrec->event;
     genie::Interaction * in = event->Summary();
 
     // Get truth stuff out of GENIE ghep record
     caf.neutrinoPDG = in->InitState().ProbePdg();
-    caf.neutrinoPDGunosc = in->InitState().ProbePdg(); // fill this for similarity with FD, but no oscillations
     caf.mode = in->ProcInfo().ScatteringTypeId();
     caf.Ev = in->InitState().ProbeE(genie::kRfLab);
     caf.LepPDG = in->FSPrimLeptonPdg();
-    caf.isCC = (abs(caf.LepPDG) == 13 || abs(caf.LepPDG) == 11);
-    
-    TLorentzVector lepP4;
-    TLorentzVector nuP4nuc = *(in->InitState().GetProbeP4(genie::kRfHitNucRest));
-    TLorentzVector nuP4 = *(in->InitState().GetProbeP4(genie::kRfLab));
-
-    caf.nP = 0;
-    caf.nN = 0;
-    caf.nipip = 0;
-    caf.nipim = 0;
-    caf.nipi0 = 0;
-    caf.nikp = 0;
-    caf.nikm = 0;
-    caf.nik0 = 0;
-    caf.niem = 0;
-    caf.niother = 0;
-    caf.nNucleus = 0;
-    caf.nUNKNOWN = 0; // there is an "other" category so this never gets used
-    caf.eP = 0.;
-    caf.eN = 0.;
-    caf.ePip = 0.;
-    caf.ePim = 0.;
-    caf.ePi0 = 0.;
-    caf.eOther = 0.;
-    caf.eRecoP = 0.;
-    caf.eRecoN = 0.;
-    caf.eRecoPip = 0.;
-    caf.eRecoPim = 0.;
-    caf.eRecoPi0 = 0.;
-    caf.eOther = 0.;
+    TLorentzVector * p4 = in->InitState().GetProbeP4(genie::kRfLab);
+    nuP4 = *p4;
+    delete p4;
+  }
+  caf.neutrinoPDGunosc = caf.neutrinoPDG; // fill this for similarity with FD, but no oscillations
+  caf.isCC = (abs(caf.LepPDG) == 13 || abs(caf.LepPDG) == 11);
+
+  caf.nP = 0;
+  caf.nN = 0;
+  caf.nipip = 0;
+  caf.nipim = 0;
+  caf.nipi0 = 0;
+  caf.nikp = 0;
+  caf.nikm = 0;
+  caf.nik0 = 0;
+  caf.niem = 0;
+  caf.niother = 0;
+  caf.nNucleus = 0;
+  caf.nUNKNOWN = 0; // there is an "other" category so this never gets used
+  caf.eP = 0.;
+  caf.eN = 0.;
+  caf.ePip = 0.;
+  caf.ePim = 0.;
+  caf.ePi0 = 0.;
+  caf.eOther = 0.;
+  caf.eRecoP = 0.;
+  caf.eRecoN = 0.;
+  caf.eRecoPip = 0.;
+  caf.eRecoPim = 0.;
+  caf.eRecoPi0 = 0.;
+  caf.eOther = 0.;
+  for( int i = 0; i < nFS; ++i ) {
+    double ke = 0.001*(fsE[i] - sqrt(fsE[i]*fsE[i] - fsPx[i]*fsPx[i] - fsPy[i]*fsPy[i] - fsPz[i]*fsPz[i]));
+    if( fsPdg[i] == caf.LepPDG ) {
+      lepP4.SetPxPyPzE( fsPx[i]*0.001, fsPy[i]*0.001, fsPz[i]*0.001, fsE[i]*0.001 );
+      caf.LepE = fsE[i]*0.001;
+    }
+    else if( fsPdg[i] == 2212 ) {caf.nP++; caf.eP += ke;}
+    else if( fsPdg[i] == 2112 ) {caf.nN++; caf.eN += ke;}
+    else if( fsPdg[i] ==  211 ) {caf.nipip++; caf.ePip += ke;}
+    else if( fsPdg[i] == -211 ) {caf.nipim++; caf.ePim += ke;}
+    else if( fsPdg[i] ==  111 ) {caf.nipi0++; caf.ePi0 += ke;}
+    else if( fsPdg[i] ==  321 ) {caf.nikp++; caf.eOther += ke;}
+    else if( fsPdg[i] == -321 ) {caf.nikm++; caf.eOther += ke;}
+    else if( fsPdg[i] == 311 || fsPdg[i] == -311 || fsPdg[i] == 130 || fsPdg[i] == 310 ) {caf.nik0++; caf.eOther += ke;}
+    else if( fsPdg[i] ==   22 ) {caf.niem++; caf.eOther += ke;}
+    else if( fsPdg[i] > 1000000000 ) caf.nNucleus++;
+    else {caf.niother++; caf.eOther += ke;}
+  }
+
+  // true 4-momentum transfer
+  TLorentzVector q = nuP4-lepP4;
+
+  // Q2, W, x, y frequently do not get filled in GENIE Kinematics object, so calculate manually
+  caf.Q2 = -q.Mag2();
+  caf.W = sqrt(0.939*0.939 + 2.*q.E()*0.939 + q.Mag2()); // "Wexp"
+  caf.X = -q.Mag2()/(2*0.939*q.E());
+  caf.Y = q.E()/caf.Ev;
+
+  caf.theta_reco = -1.; // default value
+
+  caf.NuMomX = nuP4.X();
+  caf.NuMomY = nuP4.Y();
+  caf.NuMomZ = nuP4.Z();
+  caf.LepMomX = lepP4.X();
+  caf.LepMomY = lepP4.Y();
+  caf.LepMomZ = lepP4.Z();
+  caf.LepE = lepP4.E();
+  caf.LepNuAngle = nuP4.Angle( lepP4.Vect() );
+
+  // DUNErw weights are added for the whole batch at once, after the workers are done
+
+  //--------------------------------------------------------------------------
+  // Parameterized reconstruction: the final-state scan is done here, the smearing a block at a time
+  //--------------------------------------------------------------------------
+  if( !par.IsGasTPC ) {
+    // Loop over final-state particles
+    FSScan &scan = slot.scan;
+    scan.longest_mip = 0.;
+    scan.longest_mip_KE = 0.;
+    scan.longest_mip_charge = 0;
+    caf.reco_lepton_pdg = 0;
+    scan.electrons = 0;
+    scan.electron_energy = 0.;
+    scan.reco_electron_pdg = 0;
     for( int i = 0; i < nFS; ++i ) {
-      double ke = 0.001*(fsE[i] - sqrt(fsE[i]*fsE[i] - fsPx[i]*fsPx[i] - fsPy[i]*fsPy[i] - fsPz[i]*fsPz[i]));
-      if( fsPdg[i] == caf.LepPDG ) {
-        lepP4.SetPxPyPzE( fsPx[i]*0.001, fsPy[i]*0.001, fsPz[i]*0.001, fsE[i]*0.001 );
-        caf.LepE = fsE[i]*0.001;
+      int pdg = fsPdg[i];
+      double p = sqrt(fsPx[i]*fsPx[i] + fsPy[i]*fsPy[i] + fsPz[i]*fsPz[i]);
+      double KE = fsE[i] - sqrt(fsE[i]*fsE[i] - p*p);
+
+      if( (abs(pdg) == 13 || abs(pdg) == 211) && fsTrkLen[i] > scan.longest_mip ) {
+        scan.longest_mip = fsTrkLen[i];
+        scan.longest_mip_KE = KE;
+        caf.reco_lepton_pdg = pdg;
+        if( pdg == 13 || pdg == -211 ) scan.longest_mip_charge = -1;
+        else scan.longest_mip_charge = 1;
       }
-      else if( fsPdg[i] == 2212 ) {caf.nP++; caf.eP += ke;}
-      else if( fsPdg[i] == 2112 ) {caf.nN++; caf.eN += ke;}
-      else if( fsPdg[i] ==  211 ) {caf.nipip++; caf.ePip += ke;}
-      else if( fsPdg[i] == -211 ) {caf.nipim++; caf.ePim += ke;}
-      else if( fsPdg[i] ==  111 ) {caf.nipi0++; caf.ePi0 += ke;}
-      else if( fsPdg[i] ==  321 ) {caf.nikp++; caf.eOther += ke;}
-      else if( fsPdg[i] == -321 ) {caf.nikm++; caf.eOther += ke;}
-      else if( fsPdg[i] == 311 || fsPdg[i] == -311 || fsPdg[i] == 130 || fsPdg[i] == 310 ) {caf.nik0++; caf.eOther += ke;}
-      else if( fsPdg[i] ==   22 ) {caf.niem++; caf.eOther += ke;}
-      else if( fsPdg[i] > 1000000000 ) caf.nNucleus++;
-      else {caf.niother++; caf.eOther += ke;}
-    }
 
-    // true 4-momentum transfer
-    TLorentzVector q = nuP4-lepP4;
-
-    // Q2, W, x, y frequently do not get filled in GENIE Kinematics object, so calculate manually
-    caf.Q2 = -q.Mag2();
-    caf.W = sqrt(0.939*0.939 + 2.*q.E()*0.939 + q.Mag2()); // "Wexp"
-    caf.X = -q.Mag2()/(2*0.939*q.E());
-    caf.Y = q.E()/caf.Ev;
-
-    caf.theta_reco = -1.; // default value
-
-    caf.NuMomX = nuP4.X();
-    caf.NuMomY = nuP4.Y();
-    caf.NuMomZ = nuP4.Z();
-    caf.LepMomX = lepP4.X();
-    caf.LepMomY = lepP4.Y();
-    caf.LepMomZ = lepP4.Z();
-    caf.LepE = lepP4.E();
-    caf.LepNuAngle = nuP4.Angle( lepP4.Vect() );
-
-    // Add DUNErw weights to the CAF
-
-    systtools::event_unit_response_w_cv_t resp = rh.GetEventVariationAndCVResponse(*event);
-    for( systtools::event_unit_response_w_cv_t::iterator it = resp.begin(); it != resp.end(); ++it ) {
-      caf.nwgt[(*it).pid] = (*it).responses.size();
-      caf.cvwgt[(*it).pid] = (*it).CV_response;
-      for( unsigned int i = 0; i < (*it).responses.size(); ++i ) {
-        caf.wgt[(*it).pid][i] = (*it).responses[i];
+      // pi0 as nu_e
+      if( pdg == 111 ) {
+        TVector3 g1, g2;
+        TLorentzVector pi0( fsPx[i], fsPy[i], fsPz[i], fsE[i] );
+        decayPi0( pi0, g1, g2, rngPi0 );
+        double g1conv = rngPi0.Exp( 14. ); // conversion distance
+        bool compton = (rngPi0.Rndm() < 0.15); // dE/dX misID probability for photon
+        // if energetic gamma converts in first wire, and other gamma is either too soft or too colinear
+        if( g1conv < 2.0 && compton && (g2.Mag() < 50. || g1.Angle(g2) < 0.01) ) scan.electrons++;
+        scan.electron_energy = g1.Mag();
+        scan.reco_electron_pdg = 111;
       }
     }
 
-    //--------------------------------------------------------------------------
-    // Parameterized reconstruction
-    //--------------------------------------------------------------------------
-    if( !par.IsGasTPC ) {
-      // Loop over final-state particles
-      double longest_mip = 0.;
-      double longest_mip_KE = 0.;
-      int longest_mip_charge = 0;
-      caf.reco_lepton_pdg = 0;
-      int electrons = 0;
-      double electron_energy = 0.;
-      int reco_electron_pdg = 0;
-      for( int i = 0; i < nFS; ++i ) {
-        int pdg = fsPdg[i];
-        double p = sqrt(fsPx[i]*fsPx[i] + fsPy[i]*fsPy[i] + fsPz[i]*fsPz[i]);
-        double KE = fsE[i] - sqrt(fsE[i]*fsE[i] - p*p);
-
-        if( (abs(pdg) == 13 || abs(pdg) == 211) && fsTrkLen[i] > longest_mip ) {
-          longest_mip = fsTrkLen[i];
-          longest_mip_KE = KE;
-          caf.reco_lepton_pdg = pdg;
-          if( pdg == 13 || pdg == -211 ) longest_mip_charge = -1;
-          else longest_mip_charge = 1;
-        }
+    if( abs(lepPdg) == 11 ) { // true nu_e
+      scan.electrons++;
+      scan.reco_electron_pdg = lepPdg;
+    }
+  }
 
-        // pi0 as nu_e
-        if( pdg == 111 ) {
-          TVector3 g1, g2;
-          TLorentzVector pi0( fsPx[i], fsPy[i], fsPz[i], fsE[i] );
-          decayPi0( pi0, g1, g2 );
-          double g1conv = rando->Exp( 14. ); // conversion distance
-          bool compton = (rando->Rndm() < 0.15); // dE/dX misID probability for photon
-          // if energetic gamma converts in first wire, and other gamma is either too soft or too colinear
-          if( g1conv < 2.0 && compton && (g2.Mag() < 50. || g1.Angle(g2) < 0.01) ) electrons++;
-          electron_energy = g1.Mag();
-          reco_electron_pdg = 111;
-        }
-      }
+  slot.ok = true;
+}
 
-      // True CC reconstruction
-      if( abs(lepPdg) == 11 ) { // true nu_e
-        recoElectron( caf, par );
-        electrons++;
-        reco_electron_pdg = lepPdg;
-      } else if( abs(lepPdg) == 13 ) { // true nu_mu
-        if     ( muonReco == 2 ) recoMuonTracker( caf, par ); // gas TPC match
-        else if( muonReco == 1 ) recoMuonLAr( caf, par ); // LAr-contained muon, this might get updated to NC...
-        else if( muonReco == 3 ) recoMuonECAL( caf, par ); // ECAL-stopper
-        else { // exiting but poorly-reconstructed muon
-          caf.Elep_reco = longest_mip * 0.0022;
-          caf.reco_q = 0;
-          caf.reco_numu = 1; caf.reco_nue = 0; caf.reco_nc = 0;
-          caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 1;
-
-          double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
-          double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
-          double evalTsmear = tsmear->Eval(caf.Elep_reco - mmu);
-          if( evalTsmear < 0. ) evalTsmear = 0.;
-          double reco_tx = true_tx + rando->Gaus(0., evalTsmear/sqrt(2.));
-          double reco_ty = true_ty + rando->Gaus(0., evalTsmear/sqrt(2.));
-          caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
-        }
-      } else { // NC -- set PID variables, will get updated later if fake CC
-        caf.Elep_reco = 0.;
-        caf.reco_q = 0;
-        caf.reco_numu = 0; caf.reco_nue = 0; caf.reco_nc = 1;
-        caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
-      }
+// CC/NC confusion, hadronic energy and pile-up, once the lepton is reconstructed; LAr only
+void finishEvent( EventSlot &slot, params &par )
+{
+  CAF &caf = slot.out;
+  const FSScan &scan = slot.scan;
+  const int lepPdg = slot.in.lepPdg, muonReco = slot.in.muonReco;
+  const float hadTot = slot.in.hadTot, hadCollar = slot.in.hadCollar;
+  const float hadP = slot.in.hadP, hadN = slot.in.hadN, hadPip = slot.in.hadPip, hadPim = slot.in.hadPim, hadPi0 = slot.in.hadPi0, hadOther = slot.in.hadOther;
+  CAFRandom rngConf( par.seed, par.run, par.subrun, slot.entry, kChargeConfusion );
+
+  // CC/NC confusion
+  if( scan.electrons == 1 && muonReco <= 1 ) { // NC or numuCC reco as nueCC
+    caf.Elep_reco = scan.electron_energy*0.001;
+    caf.reco_q = 0;
+    caf.reco_numu = 0; caf.reco_nue = 1; caf.reco_nc = 0;
+    caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
+    caf.reco_lepton_pdg = scan.reco_electron_pdg;
+  } else if( muonReco <= 1 && !(abs(lepPdg) == 11 && caf.Elep_reco > 0.) && (scan.longest_mip < par.CC_trk_length || scan.longest_mip_KE/scan.longest_mip > 3.) ) { 
+    // reco as NC
+    caf.Elep_reco = 0.;
+    caf.reco_q = 0;
+    caf.reco_numu = 0; caf.reco_nue = 0; caf.reco_nc = 1;
+    caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
+    caf.reco_lepton_pdg = 0;
+  } else if( (abs(lepPdg) == 12 || abs(lepPdg) == 14) && scan.longest_mip > par.CC_trk_length && scan.longest_mip_KE/scan.longest_mip < 3. ) { // true NC reco as CC numu
+    caf.Elep_reco = scan.longest_mip_KE*0.001 + mmu;
+    if( par.fhc ) caf.reco_q = -1;
+    else {
+      double michel = rngConf.Rndm();
+      if( scan.longest_mip_charge == 1 && michel < par.michelEff ) caf.reco_q = 1; // correct mu+
+      else if( michel < par.michelEff*0.25 ) caf.reco_q = 1; // incorrect mu-
+      else caf.reco_q = -1; // no reco Michel
+    }
+    caf.reco_numu = 1; caf.reco_nue = 0; caf.reco_nc = 0;
+    caf.muon_contained = 1; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
+  }
 
-      // CC/NC confusion
-      if( electrons == 1 && muonReco <= 1 ) { // NC or numuCC reco as nueCC
-        caf.Elep_reco = electron_energy*0.001;
-        caf.reco_q = 0;
-        caf.reco_numu = 0; caf.reco_nue = 1; caf.reco_nc = 0;
-        caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
-        caf.reco_lepton_pdg = reco_electron_pdg;
-      } else if( muonReco <= 1 && !(abs(lepPdg) == 11 && caf.Elep_reco > 0.) && (longest_mip < par.CC_trk_length || longest_mip_KE/longest_mip > 3.) ) { 
-        // reco as NC
-        caf.Elep_reco = 0.;
-        caf.reco_q = 0;
-        caf.reco_numu = 0; caf.reco_nue = 0; caf.reco_nc = 1;
-        caf.muon_contained = 0; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
-        caf.reco_lepton_pdg = 0;
-      } else if( (abs(lepPdg) == 12 || abs(lepPdg) == 14) && longest_mip > par.CC_trk_length && longest_mip_KE/longest_mip < 3. ) { // true NC reco as CC numu
-        caf.Elep_reco = longest_mip_KE*0.001 + mmu;
-        if( par.fhc ) caf.reco_q = -1;
-        else {
-          double michel = rando->Rndm();
-          if( longest_mip_charge == 1 && michel < par.michelEff ) caf.reco_q = 1; // correct mu+
-          else if( michel < par.michelEff*0.25 ) caf.reco_q = 1; // incorrect mu-
-          else caf.reco_q = -1; // no reco Michel
-        }
-        caf.reco_numu = 1; caf.reco_nue = 0; caf.reco_nc = 0;
-        caf.muon_contained = 1; caf.muon_tracker = 0; caf.muon_ecal = 0; caf.muon_exit = 0;
+  // Hadronic energy calorimetrically
+  caf.Ev_reco = caf.Elep_reco + hadTot*0.001;
+  caf.Ehad_veto = hadCollar;
+  caf.eRecoP = hadP*0.001;
+  caf.eRecoN = hadN*0.001;
+  caf.eRecoPip = hadPip*0.001;
+  caf.eRecoPim = hadPim*0.001;
+  caf.eRecoPi0 = hadPi0*0.001;
+  caf.eRecoOther = hadOther*0.001;
+
+  caf.pileup_energy = 0.;
+  CAFRandom rngPileup( par.seed, par.run, par.subrun, slot.entry, kPileup );
+  if( rngPileup.Rndm() < par.pileup_frac ) caf.pileup_energy = rngPileup.Rndm() * par.pileup_max;
+  caf.Ev_reco += caf.pileup_energy;
+}
+
+// reference parameterized reconstruction of one event into caf, normally slot.out
+void recoReference( CAF &caf, EventSlot &slot, params &par )
+{
+  if( !par.IsGasTPC ) {
+    CAFRandom rngLep( par.seed, par.run, par.subrun, slot.entry, kLeptonReco );
+    recoLepton( caf, par, rngLep, slot.in.lepPdg, slot.in.muonReco, slot.scan.longest_mip );
+  } else recoGasTPC( caf, slot.in, par, slot.entry );
+}
+
+// lepton reco category, the same choice recoLepton makes
+int leptonKind( int lepPdg, int muonReco )
+{
+  if( abs(lepPdg) == 11 ) return kLepElectron;
+  if( abs(lepPdg) != 13 ) return kLepNC;
+  if( muonReco == 2 ) return kLepMuonTracker;
+  if( muonReco == 1 ) return kLepMuonLAr;
+  if( muonReco == 3 ) return kLepMuonECAL;
+  return kLepMuonExit;
+}
+
+bool sameReco( double a, double b )
+{
+  if( a != a || b != b ) return ( a != a && b != b ); // NaN only matches NaN
+  return fabs(a - b) <= 1.E-9 * std::max( 1., fabs(a) );
+}
+
+// compare the batch reco in caf with the reference reco in ref, complain about the first few differences
+void checkReco( Worker &w, const CAF &caf, const CAF &ref, params &par )
+{
+  bool same = sameReco( caf.Elep_reco, ref.Elep_reco ) && sameReco( caf.theta_reco, ref.theta_reco ) && caf.reco_q == ref.reco_q &&
+              caf.reco_numu == ref.reco_numu && caf.reco_nue == ref.reco_nue && caf.reco_nc == ref.reco_nc && caf.muon_tracker == ref.muon_tracker;
+  if( !par.IsGasTPC ) {
+    same = same && caf.muon_contained == ref.muon_contained && caf.muon_ecal == ref.muon_ecal && caf.muon_exit == ref.muon_exit;
+  } else {
+    same = same && sameReco( caf.Ev_reco, ref.Ev_reco ) && caf.gastpc_pi_pl_mult == ref.gastpc_pi_pl_mult && caf.gastpc_pi_min_mult == ref.gastpc_pi_min_mult;
+    for( int i = 0; i < caf.nFSP; ++i ) same = same && sameReco( caf.partEvReco[i], ref.partEvReco[i] );
+  }
+  if( same ) return;
+  if( w.mismatches < 10 ) {
+    printf( "Batch reco differs from reference for event %d: Elep %g vs %g, theta %g vs %g, q %d vs %d\n",
+            caf.event, caf.Elep_reco, ref.Elep_reco, caf.theta_reco, ref.theta_reco, caf.reco_q, ref.reco_q );
+  }
+  w.mismatches++;
+}
+
+// parameterized reconstruction of slots [lo, hi) with the batch kernel
+void recoBlock( Worker &w, std::vector<EventSlot> &slots, int lo, int hi, params &par )
+{
+  RecoKernelParams kp;
+  kp.fhc = par.fhc;
+  kp.trk_muRes = par.trk_muRes; kp.LAr_muRes = par.LAr_muRes; kp.ECAL_muRes = par.ECAL_muRes;
+  kp.em_const = par.em_const; kp.em_sqrtE = par.em_sqrtE;
+  kp.michelEff = par.michelEff;
+  kp.thetaRes = thetaRes;
+  kp.gastpc_B = par.gastpc_B; kp.gastpc_padPitch = par.gastpc_padPitch; kp.gastpc_X0 = par.gastpc_X0;
+
+  std::vector<int> events;
+  for( int s = lo; s < hi; ++s ) if( slots[s].ok ) events.push_back( s );
+  int n = events.size();
+  double u[kLepUniforms > kGasUniforms ? kLepUniforms : kGasUniforms];
+
+  if( !par.IsGasTPC ) {
+    // gather the leptons, with each event's uniforms from its own lepton stream
+    LeptonBatch &b = w.leptons;
+    b.resize( n );
+    for( int j = 0; j < n; ++j ) {
+      EventSlot &slot = slots[events[j]];
+      const CAF &caf = slot.out;
+      b.kind[j] = leptonKind( slot.in.lepPdg, slot.in.muonReco );
+      b.pdg[j] = caf.LepPDG;
+      b.E[j] = caf.LepE;
+      b.px[j] = caf.LepMomX; b.py[j] = caf.LepMomY; b.pz[j] = caf.LepMomZ;
+      b.longest_mip[j] = slot.scan.longest_mip;
+      CAFRandom rngLep( par.seed, par.run, par.subrun, slot.entry, kLeptonReco );
+      rngLep.RndmArray( kLepUniforms, u );
+      for( int k = 0; k < kLepUniforms; ++k ) b.u[k*n + j] = u[k];
+    }
+
+    recoLeptons( b, kp );
+
+    // scatter back
+    for( int j = 0; j < n; ++j ) {
+      EventSlot &slot = slots[events[j]];
+      CAF &caf = slot.out;
+      if( w.check ) {
+        w.check->copyEvent( caf );
+        recoReference( *w.check, slot, par );
+      }
+      caf.Elep_reco = b.Elep_reco[j];
+      caf.theta_reco = b.theta_reco[j];
+      caf.reco_q = b.reco_q[j];
+      caf.reco_numu = b.reco_numu[j]; caf.reco_nue = b.reco_nue[j]; caf.reco_nc = b.reco_nc[j];
+      caf.muon_contained = b.muon_contained[j]; caf.muon_tracker = b.muon_tracker[j];
+      caf.muon_ecal = b.muon_ecal[j]; caf.muon_exit = b.muon_exit[j];
+      if( b.kind[j] == kLepElectron && !b.reco_nue[j] ) caf.Ev_reco = b.E[j]; // electron energy goes in Ev anyway
+      else if( b.kind[j] != kLepNC && b.kind[j] != kLepMuonExit ) caf.Ev_reco = b.Elep_reco[j];
+      if( w.check ) checkReco( w, caf, *w.check, par );
+    }
+  } else {
+    // gather every final-state particle of the block, each with the uniforms of its own stream
+    GasTrackBatch &b = w.tracks;
+    int ntracks = 0;
+    for( int j = 0; j < n; ++j ) ntracks += slots[events[j]].in.nFS;
+    b.resize( ntracks );
+    int t = 0;
+    for( int j = 0; j < n; ++j ) {
+      EventSlot &slot = slots[events[j]];
+      const DumpEvent &d = slot.in;
+      double lep_tx = 1000.*atan(slot.out.LepMomX / slot.out.LepMomZ);
+      double lep_ty = 1000.*atan(slot.out.LepMomY / slot.out.LepMomZ);
+      for( int i = 0; i < d.nFS; ++i, ++t ) {
+        b.pdg[t] = d.fsPdg[i];
+        b.px[t] = d.fsPx[i]; b.py[t] = d.fsPy[i]; b.pz[t] = d.fsPz[i]; b.E[t] = d.fsE[i];
+        b.trkLen[t] = d.fsTrkLen[i]; b.trkLenPerp[t] = d.fsTrkLenPerp[i];
+        b.lep_tx[t] = lep_tx; b.lep_ty[t] = lep_ty;
+        CAFRandom rngGas( par.seed, par.run, par.subrun, slot.entry, kGasTPC + i );
+        rngGas.RndmArray( kGasUniforms, u );
+        for( int k = 0; k < kGasUniforms; ++k ) b.u[k*ntracks + t] = u[k];
       }
+    }
 
-      // Hadronic energy calorimetrically
-      caf.Ev_reco = caf.Elep_reco + hadTot*0.001;
-      caf.Ehad_veto = hadCollar;
-      caf.eRecoP = hadP*0.001;
-      caf.eRecoN = hadN*0.001;
-      caf.eRecoPip = hadPip*0.001;
-      caf.eRecoPim = hadPim*0.001;
-      caf.eRecoPi0 = hadPi0*0.001;
-      caf.eRecoOther = hadOther*0.001;
-
-      caf.pileup_energy = 0.;
-      if( rando->Rndm() < par.pileup_frac ) caf.pileup_energy = rando->Rndm() * par.pileup_max;
-      caf.Ev_reco += caf.pileup_energy;
-    } else {
-      // gas TPC: FS particle loop look for long enough tracks and smear momenta
+    recoGasTracks( b, kp );
+
+    // per-event sums, in particle order like the reference
+    t = 0;
+    for( int j = 0; j < n; ++j ) {
+      EventSlot &slot = slots[events[j]];
+      const DumpEvent &d = slot.in;
+      CAF &caf = slot.out;
+      if( w.check ) {
+        w.check->copyEvent( caf );
+        recoReference( *w.check, slot, par );
+      }
       caf.Ev_reco = 0.;
-      caf.nFSP = nFS;
-      for( int i = 0; i < nFS; ++i ) {
-        double ptrue = 0.001*sqrt(fsPx[i]*fsPx[i] + fsPy[i]*fsPy[i] + fsPz[i]*fsPz[i]);
-        double mass = 0.001*sqrt(fsE[i]*fsE[i] - fsPx[i]*fsPx[i] - fsPy[i]*fsPy[i] - fsPz[i]*fsPz[i]);
-        caf.pdg[i] = fsPdg[i];
-        caf.ptrue[i] = ptrue;
-        caf.trkLen[i] = fsTrkLen[i];
-        caf.trkLenPerp[i] = fsTrkLenPerp[i];
-        // track length cut 6cm according to T Junk
-        if( fsTrkLen[i] > 0. && fsPdg[i] != 2112 ) { // basically select charged particles; somehow neutrons ocasionally get nonzero track length
-          double pT = 0.001*sqrt(fsPy[i]*fsPy[i] + fsPz[i]*fsPz[i]); // transverse to B field, in GeV
-          double nHits = fsTrkLen[i] / par.gastpc_padPitch; // doesn't matter if not integer as only used in eq
-          // Gluckstern formula, sigmapT/pT, with sigmaX and L in meters
-          double fracSig_meas = sqrt(720./(nHits+4)) * (0.01*par.gastpc_padPitch/sqrt(12.)) * pT / (0.3 * par.gastpc_B * 0.0001 * fsTrkLenPerp[i]*fsTrkLenPerp[i]);
-          // multiple scattering term
-          double fracSig_MCS = 0.052 / (par.gastpc_B * sqrt(par.gastpc_X0*fsTrkLenPerp[i]*0.0001));
-
-          double sigmaP = ptrue * sqrt( fracSig_meas*fracSig_meas + fracSig_MCS*fracSig_MCS );
-          double preco = rando->Gaus( ptrue, sigmaP );
-          double ereco = sqrt( preco*preco + mass*mass ) - mass; // kinetic energy
-          if( abs(fsPdg[i]) == 211 ) ereco += mass; // add pion mass
-          else if( fsPdg[i] == 2212 && preco > 1.5 ) ereco += 0.1395; // mistake pion mass for high-energy proton
-          caf.partEvReco[i] = ereco;
-
-          // threshold cut
-          if( fsTrkLen[i] > par.gastpc_len ) {
-            caf.Ev_reco += ereco;
-            if( fsPdg[i] == 211 || (fsPdg[i] == 2212 && preco > 1.5) ) caf.gastpc_pi_pl_mult++;
-            else if( fsPdg[i] == -211 ) caf.gastpc_pi_min_mult++;
+      caf.nFSP = d.nFS;
+      for( int i = 0; i < d.nFS; ++i, ++t ) {
+        caf.pdg[i] = d.fsPdg[i];
+        caf.ptrue[i] = b.ptrue[t];
+        caf.trkLen[i] = d.fsTrkLen[i];
+        caf.trkLenPerp[i] = d.fsTrkLenPerp[i];
+        if( b.tracked[t] ) {
+          caf.partEvReco[i] = b.ereco[t];
+          // track length cut 6cm according to T Junk
+          if( d.fsTrkLen[i] > par.gastpc_len ) {
+            caf.Ev_reco += b.ereco[t];
+            if( d.fsPdg[i] == 211 || (d.fsPdg[i] == 2212 && b.preco[t] > 1.5) ) caf.gastpc_pi_pl_mult++;
+            else if( d.fsPdg[i] == -211 ) caf.gastpc_pi_min_mult++;
           }
-
-          if( (fsPdg[i] == 13 || fsPdg[i] == -13) && fsTrkLen[i] > 100. ) { // muon, don't really care about nu_e CC for now
-            caf.Elep_reco = sqrt(preco*preco + mass*mass);
-            // angle reconstruction
-            double true_tx = 1000.*atan(caf.LepMomX / caf.LepMomZ);
-            double true_ty = 1000.*atan(caf.LepMomY / caf.LepMomZ);
-            double evalTsmear = tsmear->Eval(caf.Elep_reco - mmu);
-            if( evalTsmear < 0. ) evalTsmear = 0.;
-            double reco_tx = true_tx + rando->Gaus(0., evalTsmear/sqrt(2.));
-            double reco_ty = true_ty + rando->Gaus(0., evalTsmear/sqrt(2.));
-            caf.theta_reco = 0.001*sqrt( reco_tx*reco_tx + reco_ty*reco_ty );
-            // assume perfect charge reconstruction
-            caf.reco_q = (fsPdg[i] > 0 ? -1 : 1);
+          if( b.muon[t] ) { // muon, don't really care about nu_e CC for now
+            caf.Elep_reco = b.Elep_reco[t];
+            caf.theta_reco = b.theta_reco[t];
+            caf.reco_q = (d.fsPdg[i] > 0 ? -1 : 1);
             caf.reco_numu = 1; caf.reco_nue = 0; caf.reco_nc = 0;
             caf.muon_tracker = 1;
           }
-        } else if( fsPdg[i] == 111 || fsPdg[i] == 22 ) {
-          double ereco = 0.001 * rando->Gaus( fsE[i], 0.1*fsE[i] );
-          caf.partEvReco[i] = ereco;
-          caf.Ev_reco += ereco;
+        } else if( b.showered[t] ) {
+          caf.partEvReco[i] = b.ereco[t];
+          caf.Ev_reco += b.ereco[t];
         }
       }
+      if( w.check ) checkReco( w, caf, *w.check, par );
+    }
+  }
+}
+
+// process slots [lo, hi) of a batch on the calling thread with worker w's state
+void runWorker( Worker &w, std::vector<EventSlot> &slots, int lo, int hi, params &par )
+{
+  // this worker's own GHEP files, in order; each one after the first is opened while the one before is processed
+  // (not with truth tables, which only need the GHEP files that have none)
+  std::vector<int> files;
+  for( int s = lo; s < hi && !w.truth; ++s ) {
+    if( files.empty() || files.back() != slots[s].in.ifileNo ) files.push_back( slots[s].in.ifileNo );
+  }
+  unsigned int ifile = 0;
+  if( files.size() > 1 ) w.ghep->prefetch( files[1] );
+  for( int s = lo; s < hi; ++s ) {
+    if( ifile + 1 < files.size() && slots[s].in.ifileNo == files[ifile+1] ) {
+      ++ifile;
+      if( ifile + 1 < files.size() ) w.ghep->prefetch( files[ifile+1] );
+    }
+    processEvent( slots[s], w, par );
+  }
+
+  if( par.batch_reco ) recoBlock( w, slots, lo, hi, par );
+  else for( int s = lo; s < hi; ++s ) if( slots[s].ok ) recoReference( slots[s].out, slots[s], par );
+
+  if( !par.IsGasTPC ) {
+    for( int s = lo; s < hi; ++s ) if( slots[s].ok ) finishEvent( slots[s], par );
+  }
+}
+
+// What one makeCAF job read and wrote, so the outputs of the shards of a production can be checked against each
+// other (every input entry in one shard, every GHEP file counted once) and combined without reading the inputs again
+struct ShardManifest {
+  int shard, nshards;
+  std::string output;
+  bool edepsim;
+  int first, last; // input entries [first, last), counted over all the inputs
+  int eventFirst, eventLast; // CAF event numbers [eventFirst, eventLast)
+  std::vector<std::string> files; // input files
+  std::vector<Long64_t> offsets; // first input entry of each file, with the total at the end
+  std::vector<int> ghepFiles; // GHEP files in the order their POT was counted
+  std::vector<std::string> ghepPaths;
+  std::vector<double> ghepPot;
+  Long64_t events; // CAF entries
+  double pot;
+};
+
+static std::string jsonString( std::string s )
+{
+  std::string out = "\"";
+  for( unsigned int i = 0; i < s.size(); ++i ) {
+    if( s[i] == '"' || s[i] == '\\' ) out += '\\';
+    if( (unsigned char) s[i] < 0x20 ) out += Form( "\\u%04x", s[i] );
+    else out += s[i];
+  }
+  return out + "\"";
+}
+
+bool writeManifest( std::string filename, const ShardManifest &m )
+{
+  FILE * f = fopen( filename.c_str(), "w" );
+  if( f == NULL ) {
+    printf( "Can't write manifest %s\n", filename.c_str() );
+    return false;
+  }
+  fprintf( f, "{\n" );
+  fprintf( f, "  \"version\": 1,\n" );
+  fprintf( f, "  \"output\": %s,\n", jsonString(m.output).c_str() );
+  fprintf( f, "  \"shard\": %d,\n", m.shard );
+  fprintf( f, "  \"nshards\": %d,\n", m.nshards );
+  fprintf( f, "  \"input_type\": \"%s\",\n", (m.edepsim ? "edepsim" : "dump") );
+  fprintf( f, "  \"first\": %d,\n", m.first );
+  fprintf( f, "  \"last\": %d,\n", m.last );
+
+  // the CAF event numbers this job can have; the shards of one production never overlap
+  fprintf( f, "  \"event_first\": %d,\n", m.eventFirst );
+  fprintf( f, "  \"event_last\": %d,\n", m.eventLast );
+
+  // every input file, with the entries of it this job read, counted within the file and over all the inputs
+  fprintf( f, "  \"inputs\": [" );
+  for( unsigned int k = 0; k < m.files.size(); ++k ) {
+    Long64_t lo = std::max( (Long64_t) m.first, m.offsets[k] );
+    Long64_t hi = std::min( (Long64_t) m.last, m.offsets[k+1] );
+    if( hi < lo ) hi = lo;
+    fprintf( f, "%s\n    { \"file\": %s, \"offset\": %lld, \"entries\": %lld, \"first\": %lld, \"last\": %lld, \"entry_first\": %lld, \"entry_last\": %lld }",
+             (k ? "," : ""), jsonString(m.files[k]).c_str(), m.offsets[k], m.offsets[k+1] - m.offsets[k],
+             lo - m.offsets[k], hi - m.offsets[k], lo, hi );
+  }
+  fprintf( f, "\n  ],\n" );
+
+  fprintf( f, "  \"ghep_files\": [" );
+  for( unsigned int k = 0; k < m.ghepFiles.size(); ++k ) {
+    fprintf( f, "%s\n    { \"file_no\": %d, \"path\": %s, \"pot\": %.17g }", (k ? "," : ""), m.ghepFiles[k],
+             jsonString(m.ghepPaths[k]).c_str(), m.ghepPot[k] );
+  }
+  fprintf( f, "\n  ],\n" );
+  fprintf( f, "  \"events\": %lld,\n", m.events );
+  fprintf( f, "  \"pot\": %.17g\n", m.pot );
+  fprintf( f, "}\n" );
+  fclose( f );
+  return true;
+}
+
+// Input files from a comma-separated list of paths or glob patterns, then the lines of a list file, at most nfiles
+// of them if nfiles > 0. A pattern that matches nothing is kept as it is, so opening it reports the error.
+std::vector<std::string> expandInputs( std::string spec, std::string listfile, int nfiles )
+{
+  std::vector<std::string> files;
+  std::stringstream ss( spec );
+  std::string pattern;
+  while( std::getline(ss, pattern, ',') ) {
+    if( pattern.empty() ) continue;
+    glob_t g;
+    if( glob(pattern.c_str(), 0, NULL, &g) == 0 ) {
+      for( unsigned int i = 0; i < g.gl_pathc; ++i ) files.push_back( g.gl_pathv[i] );
+    } else files.push_back( pattern );
+    globfree( &g );
+  }
+  if( !listfile.empty() ) readFileList( listfile, files );
+  if( nfiles > 0 && (int) files.size() > nfiles ) files.resize( nfiles );
+  return files;
+}
+
+// main loop function
+void loop( CAF &caf, params &par, DumpReader &dump, std::string ghepdir, std::string fhicl_filename, ShardManifest &manifest )
+{
+  // pre-scan the (ifileNo, ievt) sequence, so the GHEP readers know which entries of each file will be used
+  std::vector<int> ghepSequence;
+  std::map<int, std::pair<int,int> > ghepEntries;
+  dump.scan( ghepSequence, ghepEntries );
+  printf( "Events use %lu GHEP files\n", ghepEntries.size() );
+
+  // One worker per thread, each with its own GHEP files
+  int nthreads = ( par.nthreads > 1 ? par.nthreads : 1 );
+  if( nthreads > 1 ) ROOT::EnableThreadSafety(); // a lone worker's GHEPReader turns it on at its first prefetch
+  std::vector<Worker> workers( nthreads );
+  for( int t = 0; t < nthreads; ++t ) {
+    workers[t].ghep = new GHEPReader( ghepdir, par.grid, par.IsGasTPC, par.fhc, par.ghep_pool, par.prefetch );
+    workers[t].ghep->setEntryRanges( ghepEntries );
+    workers[t].truth = ( par.truth_cache.empty() ? NULL : new TruthFiles(par.truth_cache) );
+    workers[t].current_file = -1;
+    workers[t].check = ( par.check_reco ? new CAF() : NULL );
+    workers[t].mismatches = 0;
+  }
+
+  // DUNE reweight getters, one per thread; without a fhicl file there are no reweight branches
+  ReweightStage * rw = ( fhicl_filename.empty() ? NULL : new ReweightStage(fhicl_filename, nthreads) );
+
+  // Get list of variations, and make CAF branch for each one
+  std::vector<unsigned int> parIds;
+  if( rw ) parIds = rw->helper().GetParameters();
+  for( unsigned int i = 0; i < parIds.size(); ++i ) {
+    systtools::SystParamHeader head = rw->helper().GetHeader(parIds[i]);
+    printf( "Adding reweight branch %u for %s with %lu shifts\n", parIds[i], head.prettyName.c_str(), head.paramVariations.size() );
+    bool is_wgt = head.isWeightSystematicVariation;
+    std::string wgt_var = ( is_wgt ? "wgt" : "var" );
+    caf.addRWbranch( parIds[i], head.prettyName, wgt_var, head.paramVariations, par.wgt_precision );
+    caf.iswgt[parIds[i]] = is_wgt;
+  }
+
+  // all the branches exist now, so the trees can be filled in the background
+  if( par.write_queue > 0 ) caf.startWriter( par.write_queue );
+
+  caf.pot = 0.;
+  int current_file = -1;
+
+  // Main event loop, a batch at a time: read the batch here, process it on the workers, then write it out in input order
+  std::vector<EventSlot> slots( nthreads * par.batch );
+  for( unsigned int s = 0; s < slots.size(); ++s ) {
+    slots[s].out.useRWLayout( caf );
+    slots[s].out.mcrec = new genie::NtpMCEventRecord();
+  }
+  while( true ) {
+    int nslots = 0;
+    while( nslots < (int) slots.size() && dump.next(slots[nslots].in, slots[nslots].entry) ) ++nslots;
+    if( nslots == 0 ) break;
+
+    // each worker takes a contiguous block of the batch, so it stays on as few GHEP files as possible
+    if( nthreads == 1 ) runWorker( workers[0], slots, 0, nslots, par );
+    else {
+      std::vector<std::thread> threads;
+      for( int t = 0; t < nthreads; ++t ) {
+        int lo = nslots * t / nthreads;
+        int hi = nslots * (t+1) / nthreads;
+        threads.push_back( std::thread(runWorker, std::ref(workers[t]), std::ref(slots), lo, hi, std::ref(par)) );
+      }
+      for( unsigned int t = 0; t < threads.size(); ++t ) threads[t].join();
     }
 
-    //printf( "Ev reco %f pion mult %d %d Elep reco %f reco numu %d reco q %d Ehad_veto %f muon_tracker %d\n", caf.Ev_reco, caf.gastpc_pi_pl_mult, caf.gastpc_pi_min_mult, caf.Elep_reco, caf.reco_numu, caf.reco_q, caf.Ehad_veto, caf.muon_tracker );
+    // reweight the good events of the batch
+    if( rw ) {
+      std::vector<genie::EventRecord*> rwEvents( nslots, (genie::EventRecord*) NULL );
+      std::vector<CAF*> rwCAFs( nslots );
+      for( int s = 0; s < nslots; ++s ) {
+        if( slots[s].ok ) rwEvents[s] = slots[s].out.mcrec->event;
+        rwCAFs[s] = &slots[s].out;
+      }
+      rw->process( rwEvents, rwCAFs );
+    }
+
+    for( int s = 0; s < nslots; ++s ) {
+      EventSlot &slot = slots[s];
+      if( !slot.ok ) continue;
+
+      // count POT once each time the GHEP file changes, as the events come in
+      if( slot.in.ifileNo != current_file ) {
+        caf.pot += slot.ghep_pot;
+        printf( "New GHEP file with %g POT, total = %g\n", slot.ghep_pot, caf.pot );
+        current_file = slot.in.ifileNo;
+        caf.addGHEPFile( current_file, workers[0].ghep->path(current_file) );
+        manifest.ghepFiles.push_back( current_file );
+        manifest.ghepPaths.push_back( workers[0].ghep->path(current_file) );
+        manifest.ghepPot.push_back( slot.ghep_pot );
+      }
+      caf.setGHEPEntry( slot.in.ifileNo, slot.in.ievt );
 
-    caf.fill();
+      caf.copyEvent( slot.out );
+      caf.fill();
+      ++manifest.events;
+    }
+  }
+
+  // close the GHEP files
+  for( int t = 0; t < nthreads; ++t ) {
+    delete workers[t].ghep;
+    delete workers[t].truth;
+  }
+  delete rw;
+  for( unsigned int s = 0; s < slots.size(); ++s ) delete slots[s].out.mcrec;
+  caf.mcrec = NULL;
+
+  if( par.check_reco ) {
+    int mismatches = 0;
+    for( int t = 0; t < nthreads; ++t ) mismatches += workers[t].mismatches;
+    printf( "Batch reco check: %d events differ from the reference reco\n", mismatches );
   }
 
   // set POT
@@ -565,8 +991,17 @@ int main( int argc, char const *argv[] )
   // get command line options
   std::string ghepdir;
   std::string outfile;
-  std::string edepfile;
+  std::string parquetfile; // optional columnar copy of the caf tree
+  std::string io_profile = "default"; // compression and basket settings of the output trees
+  std::string edepfile; // dump files: comma-separated paths or glob patterns
+  std::string filelist; // more dump files, one per line
+  std::string manifestfile;
+  std::string edepdir = ".";
   std::string fhicl_filename;
+  bool edepsim = false; // read edep-sim files directly instead of a dumpTree output
+  int first_run = 0;
+  int last_run = 0;
+  int shard = 0, nshards = 1;
 
   // Make parameter object and set defaults
   params par;
@@ -578,8 +1013,19 @@ int main( int argc, char const *argv[] )
   par.run = 1; // CAFAna doesn't like run number 0
   par.subrun = 0;
   par.n = -1;
-  par.nfiles = 1;
+  par.nfiles = 0; // all the dump files
   par.first = 0;
+  par.nthreads = 1;
+  par.batch = 64; // events per thread per batch
+  par.write_queue = 0; // events queued for the background writer, 0 fills the trees on the main thread
+  par.ghep_pool = 3; // GHEP files each thread keeps open
+  par.prefetch = true; // open the next GHEP file in the background
+  par.truth_cache = ""; // GENIE records, not truth tables
+  par.wgt_precision = kWgtDouble; // reweight branch encoding
+  par.genie_mode = kGenieFull; // full GENIE record in genieEvt
+  par.batch_reco = true; // block-at-a-time reco kernel, rather than the per-event reference functions
+  par.check_reco = false;
+  par.theta_res = "lar_theta"; // LAr driven smearing, maybe we want to change for gas?
   par.trk_muRes = 0.02; // fractional muon energy resolution of HP GAr TPC
   par.LAr_muRes = 0.05; // fractional muon energy resolution of muons contained in LAr
   par.ECAL_muRes = 0.1; // fractional muon energy resolution of muons ending in ECAL
@@ -599,12 +1045,42 @@ int main( int argc, char const *argv[] )
     if( argv[i] == std::string("--edepfile") ) {
       edepfile = argv[i+1];
       i += 2;
+    } else if( argv[i] == std::string("--filelist") ) {
+      filelist = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--shard") ) {
+      if( sscanf(argv[i+1], "%d/%d", &shard, &nshards) != 2 ) {
+        printf( "--shard wants I/N, not %s\n", argv[i+1] );
+        return 1;
+      }
+      i += 2;
+    } else if( argv[i] == std::string("--manifest") ) {
+      manifestfile = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--edepsim") ) {
+      edepsim = true;
+      i += 1;
+    } else if( argv[i] == std::string("--edepdir") ) {
+      edepdir = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--first_run") ) {
+      first_run = atoi(argv[i+1]);
+      i += 2;
+    } else if( argv[i] == std::string("--last_run") ) {
+      last_run = atoi(argv[i+1]);
+      i += 2;
     } else if( argv[i] == std::string("--ghepdir") ) {
       ghepdir = argv[i+1];
       i += 2;
     } else if( argv[i] == std::string("--outfile") ) {
       outfile = argv[i+1];
       i += 2;
+    } else if( argv[i] == std::string("--io-profile") ) {
+      io_profile = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--parquet") ) {
+      parquetfile = argv[i+1];
+      i += 2;
     } else if( argv[i] == std::string("--fhicl") ) {
       fhicl_filename = argv[i+1];
       i += 2;
@@ -621,6 +1097,44 @@ int main( int argc, char const *argv[] )
     } else if( argv[i] == std::string("--first") ) {
       par.first = atoi(argv[i+1]);
       i += 2;
+    } else if( argv[i] == std::string("--threads") ) {
+      par.nthreads = atoi(argv[i+1]);
+      i += 2;
+    } else if( argv[i] == std::string("--write-queue") ) {
+      par.write_queue = atoi(argv[i+1]);
+      i += 2;
+    } else if( argv[i] == std::string("--ghep-pool") ) {
+      par.ghep_pool = atoi(argv[i+1]);
+      i += 2;
+    } else if( argv[i] == std::string("--no-prefetch") ) {
+      par.prefetch = false;
+      i += 1;
+    } else if( argv[i] == std::string("--truth-cache") ) {
+      par.truth_cache = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--wgt-precision") ) {
+      // double, float, or ratio16: each shift's ratio to the CV in 16 bits over [0, 4], clamped and counted outside
+      std::string prec = argv[i+1];
+      if( prec == "float" ) par.wgt_precision = kWgtFloat;
+      else if( prec == "ratio16" ) par.wgt_precision = kWgtRatio16;
+      else par.wgt_precision = kWgtDouble;
+      i += 2;
+    } else if( argv[i] == std::string("--genie") ) {
+      std::string mode = argv[i+1];
+      if( mode == "ref" ) par.genie_mode = kGenieRef;
+      else if( mode == "raw" ) par.genie_mode = kGenieRaw;
+      else par.genie_mode = kGenieFull;
+      i += 2;
+    } else if( argv[i] == std::string("--reference-reco") ) {
+      par.batch_reco = false;
+      i += 1;
+    } else if( argv[i] == std::string("--check-batch-reco") ) {
+      par.batch_reco = true;
+      par.check_reco = true;
+      i += 1;
+    } else if( argv[i] == std::string("--theta-res") ) {
+      par.theta_res = argv[i+1];
+      i += 2;
     } else if( argv[i] == std::string("--oa") ) {
       par.OA_xcoord = atof(argv[i+1]);
       i += 2;
@@ -636,7 +1150,24 @@ int main( int argc, char const *argv[] )
     } else i += 1; // look for next thing
   }
 
-  printf( "Making CAF from edep-sim tree dump: %s\n", edepfile.c_str() );
+  if( nshards < 1 || shard < 0 || shard >= nshards ) {
+    printf( "No shard %d of %d\n", shard, nshards );
+    return 1;
+  }
+
+  std::vector<std::string> dumpfiles;
+  if( !edepsim ) {
+    dumpfiles = expandInputs( edepfile, filelist, par.nfiles );
+    if( dumpfiles.empty() ) {
+      printf( "No edep-sim tree dump given\n" );
+      return 1;
+    }
+  }
+
+  if( edepsim ) printf( "Making CAF from edep-sim runs %d-%d here: %s\n", first_run, last_run, edepdir.c_str() );
+  else if( dumpfiles.size() == 1 ) printf( "Making CAF from edep-sim tree dump: %s\n", dumpfiles[0].c_str() );
+  else printf( "Making CAF from %lu edep-sim tree dumps, %s to %s\n", dumpfiles.size(), dumpfiles.front().c_str(), dumpfiles.back().c_str() );
+  if( nshards > 1 ) printf( "Shard %d of %d\n", shard, nshards );
   printf( "Searching for GENIE ghep files here: %s\n", ghepdir.c_str() );
   if( par.fhc ) printf( "Running neutrino mode (FHC)\n" );
   else printf( "Running antineutrino mode (RHC)\n" );
@@ -644,24 +1175,81 @@ int main( int argc, char const *argv[] )
   else printf( "Running test mode\n" );
   printf( "Output CAF file: %s\n", outfile.c_str() );
   if( par.IsGasTPC ) printf( "Running gas TPC\n" );
+  if( par.nthreads > 1 ) printf( "Running with %d threads\n", par.nthreads );
+
+  thetaRes = getResolution( par.theta_res );
+  if( thetaRes == NULL ) {
+    printf( "Unknown angular resolution %s, choose one of:", par.theta_res.c_str() );
+    std::vector<std::string> names = resolutionNames();
+    for( unsigned int j = 0; j < names.size(); ++j ) printf( " %s", names[j].c_str() );
+    printf( "\n" );
+    return 1;
+  }
+  printf( "Angular resolution: %s\n", par.theta_res.c_str() );
+
+  // the tables have no records, so nothing can be reweighted or stored whole
+  if( !par.truth_cache.empty() ) {
+    if( !fhicl_filename.empty() || par.genie_mode == kGenieFull ) {
+      printf( "--truth-cache has no GENIE records to reweight or store: use it with --genie ref or raw, and without --fhicl\n" );
+      return 1;
+    }
+    printf( "Reading GENIE truth from the tables in %s where there are any\n", par.truth_cache.c_str() );
+  }
+
+  if( getIOProfile(io_profile) == NULL ) {
+    printf( "Unknown I/O profile %s, choose one of:", io_profile.c_str() );
+    std::vector<std::string> names = ioProfileNames();
+    for( unsigned int j = 0; j < names.size(); ++j ) printf( " %s", names[j].c_str() );
+    printf( "\n" );
+    return 1;
+  }
 
-  rando = new TRandom3( par.seed );
-  CAF caf( outfile, par.IsGasTPC );
+  CAF caf( outfile, par.IsGasTPC, par.genie_mode, io_profile );
+  if( !parquetfile.empty() && caf.addColumnOutput(parquetfile) ) printf( "Columnar copy of the caf tree: %s\n", parquetfile.c_str() );
 
-  // LAr driven smearing, maybe we want to change for gas?
-  tsmear = new TF1( "tsmear", "0.162 + 3.407*pow(x,-1.) + 3.129*pow(x,-0.5)", 0., 999.9 );
+  // with --edepsim, --first and --nevents count edep-sim entries
+  EdepDump * edep = NULL;
+  DumpReader * dump = NULL;
+  if( edepsim ) {
+    edep = new EdepDump( edepdir, first_run, last_run, !par.fhc, par.grid, par.IsGasTPC );
+    dump = new DumpReader( edep, par.first, par.n );
+  } else {
+    TChain * tree = new TChain( "tree" );
+    for( unsigned int k = 0; k < dumpfiles.size(); ++k ) tree->Add( dumpfiles[k].c_str() );
+    dump = new DumpReader( tree, par.first, par.n );
+  }
 
-  TFile * tf = new TFile( edepfile.c_str() );
-  TTree * tree = (TTree*) tf->Get( "tree" );
+  // --first and --nevents pick the entries to share out, as if there were one job
+  if( nshards > 1 ) dump->shard( shard, nshards );
 
-  loop( caf, par, tree, ghepdir, fhicl_filename );
+  ShardManifest manifest;
+  manifest.shard = shard;
+  manifest.nshards = nshards;
+  manifest.output = outfile;
+  manifest.edepsim = edepsim;
+  manifest.first = dump->firstEntry();
+  manifest.last = dump->lastEntry();
+  manifest.eventFirst = dump->firstEvent();
+  manifest.events = 0;
+  dump->inputs( manifest.files, manifest.offsets );
+  printf( "Input entries %d to %d\n", manifest.first, manifest.last );
+
+  loop( caf, par, *dump, ghepdir, fhicl_filename, manifest );
+  manifest.eventLast = dump->nextEvent();
 
   caf.version = 4;
   printf( "Run %d POT %g\n", caf.meta_run, caf.pot );
   caf.fillPOT();
   caf.write();
 
-  caf.cafFile->Close();
+  // next to the output when sharding, so the shards can be checked and combined from their manifests alone
+  if( manifestfile.empty() && nshards > 1 ) {
+    manifestfile = outfile;
+    if( manifestfile.size() > 5 && manifestfile.compare(manifestfile.size() - 5, 5, ".root") == 0 ) manifestfile.erase( manifestfile.size() - 5 );
+    manifestfile += ".manifest.json";
+  }
+  manifest.pot = caf.pot;
+  if( !manifestfile.empty() && writeManifest(manifestfile, manifest) ) printf( "Shard manifest: %s\n", manifestfile.c_str() );
 
   printf( "-30-\n" );
 
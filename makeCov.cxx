@@ -0,0 +1,80 @@
+#include "makeCov.C"
+
+// makeCov as a program, for running it as grid jobs
+// One job for everything, writing the matrices:
+//   makeCov [--threads 8] [--nu 100] [--skim DIR]
+// One of several grid jobs, writing its partial sums; --checkpoint saves them every round of that many entries per
+// thread, and the job carries on from the last save if it is run again:
+//   makeCov --partial FILE [--shard I/N] [--universes FIRST:COUNT] [--checkpoint ENTRIES] [--threads 8] [--nu 100]
+// Adding up the partial files of all the jobs and writing the matrices:
+//   makeCov --merge FILE FILE ...
+
+int main( int argc, char const *argv[] )
+{
+  CovJob job;
+  int nU = -1;
+  bool merge = false;
+  std::vector<std::string> mergeFiles;
+
+  int i = 0;
+  while( i < argc ) {
+    if( argv[i] == std::string("--threads") ) {
+      job.nthreads = atoi( argv[i+1] );
+      i += 2;
+    } else if( argv[i] == std::string("--nu") ) {
+      job.nu = atoi( argv[i+1] );
+      i += 2;
+    } else if( argv[i] == std::string("--universes") ) {
+      if( sscanf(argv[i+1], "%d:%d", &job.firstU, &nU) != 2 ) {
+        printf( "--universes wants FIRST:COUNT, not %s\n", argv[i+1] );
+        return 1;
+      }
+      i += 2;
+    } else if( argv[i] == std::string("--shard") ) {
+      if( sscanf(argv[i+1], "%d/%d", &job.shard, &job.nShards) != 2 ) {
+        printf( "--shard wants I/N, not %s\n", argv[i+1] );
+        return 1;
+      }
+      i += 2;
+    } else if( argv[i] == std::string("--skim") ) {
+      job.skimDir = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--partial") ) {
+      job.partial = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--checkpoint") ) {
+      job.chunk = atoll( argv[i+1] );
+      i += 2;
+    } else if( argv[i] == std::string("--merge") ) {
+      merge = true;
+      i += 1;
+      while( i < argc && argv[i][0] != '-' ) mergeFiles.push_back( argv[i++] );
+    } else i += 1; // look for next thing
+  }
+
+  if( merge ) {
+    if( mergeFiles.empty() ) {
+      printf( "--merge needs the partial files\n" );
+      return 1;
+    }
+    return mergeCov( mergeFiles ) ? 0 : 1;
+  }
+
+  if( job.nthreads < 1 ) job.nthreads = 1;
+  if( nU < 0 ) nU = job.nu - job.firstU;
+  job.nU = nU;
+  if( job.nu < 1 || job.firstU < 0 || job.nU < 1 || job.firstU + job.nU > job.nu ) {
+    printf( "Universes %d to %d are not in 0 to %d\n", job.firstU, job.firstU + job.nU - 1, job.nu - 1 );
+    return 1;
+  }
+  if( job.nShards < 1 || job.shard < 0 || job.shard >= job.nShards ) {
+    printf( "No shard %d of %d\n", job.shard, job.nShards );
+    return 1;
+  }
+  if( job.partial.empty() && (job.nShards > 1 || job.nU < job.nu || job.chunk > 0) ) {
+    printf( "A shard, a block of universes or checkpoints need --partial\n" );
+    return 1;
+  }
+
+  return runCov( job ) ? 0 : 1;
+}
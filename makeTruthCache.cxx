@@ -0,0 +1,84 @@
+#include "TruthCache.C"
+#include "TFile.h"
+#include "TTree.h"
+#include "TROOT.h"
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Flat truth tables of GHEP files, for makeCAF --truth-cache and nueElasticCAF --truth-cache (see TruthCache.h)
+//   makeTruthCache [--outdir DIR] [--threads N] [--force] [--filelist FILE] [GHEP files...]
+// Each GHEP file gets its .truth.root in DIR, or next to it without --outdir. Files that already have an up to date
+// table are left alone unless --force; missing and recovered GHEP files get none.
+
+// converts files off the queue until there are none left
+void convert( const std::vector<std::string> * files, std::string outdir, bool force, std::atomic<int> * next, std::atomic<int> * made )
+{
+  TruthTable table;
+  for( int i = (*next)++; i < (int) files->size(); i = (*next)++ ) {
+    std::string ghep = (*files)[i];
+    std::string out = truthPath( ghep, outdir );
+    if( !force && table.read(out, ghep) ) {
+      printf( "%s is up to date\n", out.c_str() );
+      continue;
+    }
+
+    TFile * tf = new TFile( ghep.c_str() );
+    TTree * gtree = ( tf->IsZombie() ? NULL : (TTree*) tf->Get("gtree") );
+    if( gtree == NULL ) printf( "%s has no gtree, skipping it\n", ghep.c_str() );
+    else if( tf->TestBit(TFile::kRecovered) ) printf( "%s was recovered, skipping it\n", ghep.c_str() );
+    else if( table.fill(gtree) && table.write(out, ghep) ) {
+      printf( "%s: %lld events, %lld particles, %g POT\n", out.c_str(), table.size(), table.fsBegin.back(), table.pot );
+      ++(*made);
+    }
+    tf->Close();
+    delete tf;
+  }
+}
+
+int main( int argc, char const *argv[] )
+{
+  std::string outdir;
+  std::string filelist;
+  std::vector<std::string> files;
+  int nthreads = 1;
+  bool force = false;
+
+  int i = 1;
+  while( i < argc ) {
+    if( argv[i] == std::string("--outdir") ) {
+      outdir = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--filelist") ) {
+      filelist = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--threads") ) {
+      nthreads = atoi( argv[i+1] );
+      i += 2;
+    } else if( argv[i] == std::string("--force") ) {
+      force = true;
+      i += 1;
+    } else files.push_back( argv[i++] );
+  }
+
+  if( !filelist.empty() && !readFileList(filelist, files) ) return 1;
+  if( files.empty() ) {
+    printf( "No GHEP files given\n" );
+    return 1;
+  }
+  if( nthreads < 1 ) nthreads = 1;
+  if( nthreads > (int) files.size() ) nthreads = files.size();
+
+  std::atomic<int> next( 0 ), made( 0 );
+  if( nthreads == 1 ) convert( &files, outdir, force, &next, &made );
+  else {
+    ROOT::EnableThreadSafety();
+    std::vector<std::thread> threads;
+    for( int t = 0; t < nthreads; ++t ) threads.push_back( std::thread(convert, &files, outdir, force, &next, &made) );
+    for( int t = 0; t < nthreads; ++t ) threads[t].join();
+  }
+  printf( "Made %d truth tables for %lu GHEP files\n", (int) made, files.size() );
+  return 0;
+}
@@ -1,14 +1,21 @@
 #include <TFile.h>
 #include <TTree.h>
 #include <TChain.h>
-#include <TRandom3.h>
 #include <TVector3.h>
 #include <TLorentzVector.h>
-#include <TF1.h>
 #include <stdio.h>
 #include <math.h>
+#include <unistd.h>
+#include <atomic>
+#include <sstream>
+#include <thread>
 #include "nusystematics/artless/response_helper.hh"
 #include "CAF.C"
+#include "CAFColumns.C"
+#include "IOProfile.C"
+#include "CAFRandom.C"
+#include "Resolution.C"
+#include "TruthCache.C"
 
 // genie includes
 #include "EVGCore/EventRecord.h"
@@ -26,50 +33,46 @@ using namespace genie;
 const double me  = 0.511E-3; // GeV
 const double mmu = 0.10537; // GeV
 
-// initialize variable resolutions
-TF1 * esmear;
-TF1 * tsmear1;
-TF1 * tsmear2;
-TF1 * tsmearRatio;
+// variable resolutions, compiled functions chosen by name (see Resolution.C)
+ResolutionFn esmear;
+ResolutionFn tsmear1;
+ResolutionFn tsmear2;
+ResolutionFn tsmearRatio;
 
-TF1 * doubleGaus;
-
-TRandom3 * rando;
+// random numbers come from a CAFRandom stream per event, keyed on (seed, run, file, event)
+const unsigned int seed = 12345;
 
 nusyst::response_helper rh( "./fhicl.fcl" );
 
-void init()
+bool init( std::string esmearName, std::string coreName, std::string tailName, std::string ratioName )
 {
-  esmear = new TF1( "esmear", "0.03 + 0.05*pow(x,-0.5)", 0., 999.9 );
-  tsmear1 = new TF1( "tsmear1", "3.29 + 3.485*pow(x,-1.)", 0., 999.9 );
-  tsmear2 = new TF1( "tsmear2", "10.287 + 4.889*pow(x,-1.)", 0., 999.9 );
-  tsmearRatio = new TF1( "tsmearRatio", "0.039 + 0.551*pow(x,-1.) - 0.268*pow(x,-0.5)", 0., 999.9 );
-
-  doubleGaus = new TF1( "dg", "[0]*TMath::Exp(-0.5*pow(x/[1],2)) + [2]*TMath::Exp(-0.5*pow(x/[3],2))", -1000., 1000. );
-
-  rando = new TRandom3(12345);
+  esmear = getResolution( esmearName );
+  tsmear1 = getResolution( coreName );
+  tsmear2 = getResolution( tailName );
+  tsmearRatio = getResolution( ratioName );
+  if( esmear && tsmear1 && tsmear2 && tsmearRatio ) return true;
+
+  printf( "Unknown resolution function, choose from:" );
+  std::vector<std::string> names = resolutionNames();
+  for( unsigned int i = 0; i < names.size(); ++i ) printf( " %s", names[i].c_str() );
+  printf( "\n" );
+  return false;
 }
 
-void setDG( double Ee )
+// double-Gaussian angular smearing (mrad) for this energy
+DoubleGaussian setDG( double Ee )
 {
-  double p1 = tsmear1->Eval(Ee);
-  double p3 = tsmear2->Eval(Ee);
-  double ratio = tsmearRatio->Eval(Ee);
-
-  doubleGaus->SetParameter( 1, p1 );
-  doubleGaus->SetParameter( 3, p3 );
-  doubleGaus->SetParameter( 0, 1. );
-  doubleGaus->SetParameter( 2, ratio );
+  return DoubleGaussian( tsmear1(Ee), tsmear2(Ee), tsmearRatio(Ee) );
 }
 
-void decayPi0( TLorentzVector &pi0, TVector3 &gamma1, TVector3 &gamma2 )
+void decayPi0( TLorentzVector &pi0, TVector3 &gamma1, TVector3 &gamma2, CAFRandom &rng )
 {
   double e = pi0.E();
   double mp = 0.1349766; // pi0 mass
 
   double beta = sqrt( 1. - (mp*mp)/(e*e) ); // velocity of pi0
-  double theta = 3.1416*rando->Rndm(); // theta of gamma1 w.r.t. pi0 direction
-  double phi = 2.*3.1416*rando->Rndm(); // phi of gamma1 w.r.t. pi0 direction
+  double theta = 3.1416*rng.Rndm(); // theta of gamma1 w.r.t. pi0 direction
+  double phi = 2.*3.1416*rng.Rndm(); // phi of gamma1 w.r.t. pi0 direction
 
   double p = mp/2.; // photon momentum in pi0 rest frame
   TLorentzVector g1( 0., 0., p, p ); // pre-rotation photon 1
@@ -140,469 +143,672 @@ void RotateZu( TVector3 &v, TVector3 uu )
   v.SetXYZ( fX, fY, fZ );
 }
 
-void loop( TTree * tree, int cat, CAF &caf )
-{
-
-  //nusyst::response_helper rh( "./fhicl.fcl" );
+// midpoint of the decay pipe, relative to detector center at (0,0,0)
+const TVector3 origin(0., 4823.6, -46048.);
 
-  // midpoint of the decay pipe, relative to detector center at (0,0,0)
-  TVector3 origin(0., 4823.6, -46048.);
-
-  // Signal
-  int N = tree->GetEntries();
-
-  NtpMCEventRecord * mcrec = NULL;
-  tree->SetBranchAddress("gmcrec", &mcrec);
+// nu+e signal, event ii of the truth table of GHEP file ifile
+void fillSignal( const TruthTable &t, int ifile, int ii, CAF &caf )
+{
+  caf.setToBS();
+
+  // per-event random stream
+  CAFRandom rng( seed, 10, ifile, ii );
+
+  // Set basic CAF variables
+  caf.run = 10;
+  caf.subrun = 10;
+  caf.event = ii;
+  caf.isCC = 0;
+  caf.mode = 7; // nu+e
+  caf.LepPDG = 11; 
+  caf.isFD = 0;
+
+  caf.nP = 0; caf.nN = 0; caf.nipip = 0; caf.nipi0 = 0; caf.nikm = 0; caf.nik0 = 0; 
+  caf.niem = 0; caf.niother = 0; caf.nNucleus = 0; caf.nUNKNOWN = 0;
+  caf.eP = 0.; caf.eN = 0.; caf.ePip = 0.; caf.ePi0 = 0.; caf.eOther = 0.;
+
+  // nonsense variables
+  caf.reco_numu = 0;
+  caf.reco_nue = 1;
+  caf.reco_nc = 0;
+  caf.reco_q = 0;
+  caf.muon_contained = -1; caf.muon_tracker = -1; caf.muon_ecal = -1; caf.muon_exit = -1;
+  caf.reco_lepton_pdg = 11;
+  caf.pileup_energy = 0.;
+
+  // truth of the event
+  TLorentzVector lep( t.lepPx[ii], t.lepPy[ii], t.lepPz[ii], t.lepE[ii] );
+  TLorentzVector nu( t.nuPx[ii], t.nuPy[ii], t.nuPz[ii], t.nuE[ii] );
+  TVector3 nudir = nu.Vect().Unit();
+  TLorentzVector q = nu-lep;
+
+  TVector3 vtxO( t.vtxX[ii], t.vtxY[ii], t.vtxZ[ii] );
+  TVector3 vtx( vtxO.x()*100., vtxO.y()*100. - 305., vtxO.z()*100. - 5. );
+  caf.vtx_x = vtx.x();
+  caf.vtx_y = vtx.y();
+  caf.vtx_z = vtx.z();
+
+  caf.NuMomX = nu.X();
+  caf.NuMomY = nu.Y();
+  caf.NuMomZ = nu.Z();
+
+  // interaction-level variables
+  caf.X = -q.Mag2()/(2*0.939*q.E());
+  caf.Y = q.E() / nu.E();
+  caf.Q2 = -q.Mag2();
+  caf.W = sqrt(0.939*0.939 + 2.*q.E()*0.939 + q.Mag2());
+  caf.mode = t.scatType[ii];
+  caf.Ev = t.nuE[ii];
+
+  // Loop over the stable final-state particles, fill particle variables
+  for( Long64_t k = t.fsBegin[ii]; k < t.fsBegin[ii+1]; ++k ) {
+
+    if( t.fsPdg[k] == 11 ) {
+      TLorentzVector mom( t.fsPx[k], t.fsPy[k], t.fsPz[k], t.fsE[k] );
+      double Ttrue = mom.E() - me;
+
+      TVector3 bestnudir = (vtx - origin).Unit();
+      TVector3 best = mom.Vect();
+      RotateZu( best, bestnudir );
+
+      TVector3 perf = mom.Vect();
+      RotateZu( perf, nudir );
+
+      double best_thetaX = 1000.*atan( best.x() / best.z() );
+      double best_thetaY = 1000.*atan( best.y() / best.z() );
+
+      double evalEsmear = esmear(Ttrue);
+      if( evalEsmear < 0. ) evalEsmear = 0.;
+
+      DoubleGaussian dg = setDG(Ttrue);
+
+      double ereco = Ttrue * ( 1. + rng.Gaus(0., evalEsmear) );
+      double smearx = best_thetaX + dg.sample( rng );
+      double smeary = best_thetaY + dg.sample( rng );
+      double reco_theta = sqrt( smearx*smearx + smeary*smeary );
+
+      // Lepton truth info
+      caf.LepMomX = perf.x(); // wrt true neutrino
+      caf.LepMomY = perf.y();
+      caf.LepMomZ = perf.z();
+      caf.LepE = Ttrue;
+      caf.LepNuAngle = acos(perf.z()/perf.Mag());
+
+      //printf( "Ee %2.2f ThetaX %1.1f --> %1.1f, ThetaY %1.1f --> %1.1f true theta %1.1f reco %1.1f\n", Ttrue, best_thetaX, smearx, best_thetaY, smeary, reco_theta, caf.LepNuAngle*1000. );
+
+      double reco_y = 1. - (ereco * (1. - cos(reco_theta/1000.)))/me;
+      double reco_enu = ereco / reco_y;
+
+      // fill CAF
+      caf.Elep_reco = ereco;
+      caf.theta_reco = 0.001*reco_theta;
+      caf.Ev_reco = reco_enu; // 2D neutrino energy reco, can sometimes be negative
+      caf.Ehad_veto = 0.;
+    } // if electron
+    else if( abs(t.fsPdg[k]) == 12 || abs(t.fsPdg[k]) == 14 ) {
+      caf.neutrinoPDG = t.fsPdg[k];
+      caf.neutrinoPDGunosc = t.fsPdg[k];
+    }
+  }// end loop over particles 
 
-  if( cat == 0 ) {
+  caf.fill();
+}
 
-    // loop over events
-    for( int ii = 0; ii < N; ++ii ) {
-      tree->GetEntry( ii );
-
-      caf.setToBS();
-
-      // Set basic CAF variables
-      caf.run = 10;
-      caf.subrun = 10;
-      caf.event = ii;
-      caf.isCC = 0;
-      caf.mode = 7; // nu+e
-      caf.LepPDG = 11; 
-      caf.isFD = 0;
-
-      caf.nP = 0; caf.nN = 0; caf.nipip = 0; caf.nipi0 = 0; caf.nikm = 0; caf.nik0 = 0; 
-      caf.niem = 0; caf.niother = 0; caf.nNucleus = 0; caf.nUNKNOWN = 0;
-      caf.eP = 0.; caf.eN = 0.; caf.ePip = 0.; caf.ePi0 = 0.; caf.eOther = 0.;
-
-      // nonsense variables
-      caf.reco_numu = 0;
-      caf.reco_nue = 1;
-      caf.reco_nc = 0;
-      caf.reco_q = 0;
-      caf.muon_contained = -1; caf.muon_tracker = -1; caf.muon_ecal = -1; caf.muon_exit = -1;
-      caf.reco_lepton_pdg = 11;
-      caf.pileup_energy = 0.;
-
-      // get the GENIE event
-      EventRecord *event = mcrec->event;
-      Interaction *in = event->Summary();
-
-      TLorentzVector lep = in->Kine().FSLeptonP4();
-      TLorentzVector nu = *(in->InitState().GetProbeP4(kRfLab));
-      TVector3 nudir = nu.Vect().Unit();
-      TLorentzVector q = nu-lep;
-
-      TVector3 vtxO = event->Vertex()->Vect();
-      TVector3 vtx( vtxO.x()*100., vtxO.y()*100. - 305., vtxO.z()*100. - 5. );
-      caf.vtx_x = vtx.x();
-      caf.vtx_y = vtx.y();
-      caf.vtx_z = vtx.z();
-
-      caf.NuMomX = nu.X();
-      caf.NuMomY = nu.Y();
-      caf.NuMomZ = nu.Z();
-
-      // interaction-level variables
-      caf.X = -q.Mag2()/(2*0.939*q.E());
-      caf.Y = q.E() / nu.E();
-      caf.Q2 = -q.Mag2();
-      caf.W = sqrt(0.939*0.939 + 2.*q.E()*0.939 + q.Mag2());
-      caf.mode = in->ProcInfo().ScatteringTypeId();
-      caf.Ev = in->InitState().ProbeE(kRfLab);
-
-      // Loop over all particles in this event, fill particle variables
-      GHepParticle * p = 0;
-      TIter event_iter(event);
-
-      while((p=dynamic_cast<GHepParticle *>(event_iter.Next()))) {
-
-        if( p->Status() == kIStStableFinalState ) {
-          if( p->Pdg() == 11 ) {
-            TLorentzVector mom = *(p->P4());
-            double Ttrue = mom.E() - me;
-
-            TVector3 bestnudir = (vtx - origin).Unit();
-            TVector3 best = mom.Vect();
-            RotateZu( best, bestnudir );
-
-            TVector3 perf = mom.Vect();
-            RotateZu( perf, nudir );
-
-            double best_thetaX = 1000.*atan( best.x() / best.z() );
-            double best_thetaY = 1000.*atan( best.y() / best.z() );
-
-            double evalEsmear = esmear->Eval(Ttrue);
-            if( evalEsmear < 0. ) evalEsmear = 0.;
-
-            setDG(Ttrue);
-
-            double ereco = Ttrue * ( 1. + rando->Gaus(0., evalEsmear) );
-            double smearx = best_thetaX + doubleGaus->GetRandom();
-            double smeary = best_thetaY + doubleGaus->GetRandom();
-            double reco_theta = sqrt( smearx*smearx + smeary*smeary );
-
-            // Lepton truth info
-            caf.LepMomX = perf.x(); // wrt true neutrino
-            caf.LepMomY = perf.y();
-            caf.LepMomZ = perf.z();
-            caf.LepE = Ttrue;
-            caf.LepNuAngle = acos(perf.z()/perf.Mag());
-
-            //printf( "Ee %2.2f ThetaX %1.1f --> %1.1f, ThetaY %1.1f --> %1.1f true theta %1.1f reco %1.1f\n", Ttrue, best_thetaX, smearx, best_thetaY, smeary, reco_theta, caf.LepNuAngle*1000. );
-
-            double reco_y = 1. - (ereco * (1. - cos(reco_theta/1000.)))/me;
-            double reco_enu = ereco / reco_y;
-
-            // fill CAF
-            caf.Elep_reco = ereco;
-            caf.theta_reco = 0.001*reco_theta;
-            caf.Ev_reco = reco_enu; // 2D neutrino energy reco, can sometimes be negative
-            caf.Ehad_veto = 0.;
-          } // if electron
-          else if( abs(p->Pdg()) == 12 || abs(p->Pdg()) == 14 ) {
-            caf.neutrinoPDG = p->Pdg();
-            caf.neutrinoPDGunosc = p->Pdg();
-          }
-        }
-      }// end loop over particles 
-
-      caf.fill();
-
-      // clear current mc event record
-      mcrec->Clear();
-    } // event loop
-  } // if signal
-  else { // bkg
-
-    // loop over events
-    for( int ii = 0; ii < N; ++ii ) {
-      tree->GetEntry( ii );
-
-      caf.setToBS();
-
-      // Set basic CAF variables
-      caf.run = 10 + cat;
-      caf.subrun = 10 + cat;
-      caf.event = ii;
-      caf.isCC = 0; // overwritten in particle loop
-      caf.LepPDG = 0; // overwritten in particle loop
-      caf.isFD = 0;
-
-      caf.nP = 0; caf.nN = 0; caf.nipip = 0; caf.nipi0 = 0; caf.nikm = 0; caf.nik0 = 0; 
-      caf.niem = 0; caf.niother = 0; caf.nNucleus = 0; caf.nUNKNOWN = 0;
-      caf.eP = 0.; caf.eN = 0.; caf.ePip = 0.; caf.ePi0 = 0.; caf.eOther = 0.;
-
-      // nonsense variables
-      caf.reco_numu = 0;
-      caf.reco_nue = 1;
-      caf.reco_nc = 0;
-      caf.reco_q = 0;
-      caf.muon_contained = -1; caf.muon_tracker = -1; caf.muon_ecal = -1; caf.muon_exit = -1;
-      caf.reco_lepton_pdg = 11;
-      caf.pileup_energy = 0.;
-
-      // get the GENIE event
-      EventRecord *event = mcrec->event;
-      Interaction *in = event->Summary();
+// background event ii of the truth table of GHEP file ifile, filled if it looks like one electron (cat 1) or one
+// photon (cat 2)
+void fillBkg( const TruthTable &t, int cat, int ifile, int ii, CAF &caf )
+{
+  caf.setToBS();
+
+  // per-event random stream
+  CAFRandom rng( seed, 10 + cat, ifile, ii );
+
+  // Set basic CAF variables
+  caf.run = 10 + cat;
+  caf.subrun = 10 + cat;
+  caf.event = ii;
+  caf.isCC = 0; // overwritten in particle loop
+  caf.LepPDG = 0; // overwritten in particle loop
+  caf.isFD = 0;
+
+  caf.nP = 0; caf.nN = 0; caf.nipip = 0; caf.nipi0 = 0; caf.nikm = 0; caf.nik0 = 0; 
+  caf.niem = 0; caf.niother = 0; caf.nNucleus = 0; caf.nUNKNOWN = 0;
+  caf.eP = 0.; caf.eN = 0.; caf.ePip = 0.; caf.ePi0 = 0.; caf.eOther = 0.;
+
+  // nonsense variables
+  caf.reco_numu = 0;
+  caf.reco_nue = 1;
+  caf.reco_nc = 0;
+  caf.reco_q = 0;
+  caf.muon_contained = -1; caf.muon_tracker = -1; caf.muon_ecal = -1; caf.muon_exit = -1;
+  caf.reco_lepton_pdg = 11;
+  caf.pileup_energy = 0.;
 
 /*
-      systtools::event_unit_response_w_cv_t resp = rh.GetEventVariationAndCVResponse(*event);
-      for( systtools::event_unit_response_w_cv_t::iterator it = resp.begin(); it != resp.end(); ++it ) {
-        caf.nwgt[(*it).pid] = (*it).responses.size();
-        caf.cvwgt[(*it).pid] = (*it).CV_response;
-        for( unsigned int i = 0; i < (*it).responses.size(); ++i ) {
-          caf.wgt[(*it).pid][i] = (*it).responses[i];
-        }
-      }
+  systtools::event_unit_response_w_cv_t resp = rh.GetEventVariationAndCVResponse(*event);
+  for( systtools::event_unit_response_w_cv_t::iterator it = resp.begin(); it != resp.end(); ++it ) {
+    caf.setWeights( (*it).pid, (*it).CV_response, (*it).responses );
+  }
 */
-      TVector3 vtxO = event->Vertex()->Vect();
-      TVector3 vtx( vtxO.x()*100., vtxO.y()*100. - 305., vtxO.z()*100. - 5. );
-      caf.vtx_x = vtx.x();
-      caf.vtx_y = vtx.y();
-      caf.vtx_z = vtx.z();
-
-      TLorentzVector lep = in->Kine().FSLeptonP4();
-      TLorentzVector nu = *(in->InitState().GetProbeP4(kRfLab));
-      TVector3 nudir = nu.Vect().Unit();
-      TLorentzVector q = nu-lep;
-
-      caf.NuMomX = nu.X();
-      caf.NuMomY = nu.Y();
-      caf.NuMomZ = nu.Z();
-
-      // interaction-level variables
-      caf.X = -q.Mag2()/(2*0.939*q.E());
-      caf.Y = q.E() / nu.E();
-      caf.Q2 = -q.Mag2();
-      caf.W = sqrt(0.939*0.939 + 2.*q.E()*0.939 + q.Mag2());
-      caf.mode = in->ProcInfo().ScatteringTypeId();
-      caf.Ev = in->InitState().ProbeE(kRfLab);
-
-      if( caf.mode == 7 ) {
-        mcrec->Clear();
-        continue; // nu+e in background file
+  TVector3 vtxO( t.vtxX[ii], t.vtxY[ii], t.vtxZ[ii] );
+  TVector3 vtx( vtxO.x()*100., vtxO.y()*100. - 305., vtxO.z()*100. - 5. );
+  caf.vtx_x = vtx.x();
+  caf.vtx_y = vtx.y();
+  caf.vtx_z = vtx.z();
+
+  TLorentzVector lep( t.lepPx[ii], t.lepPy[ii], t.lepPz[ii], t.lepE[ii] );
+  TLorentzVector nu( t.nuPx[ii], t.nuPy[ii], t.nuPz[ii], t.nuE[ii] );
+  TVector3 nudir = nu.Vect().Unit();
+  TLorentzVector q = nu-lep;
+
+  caf.NuMomX = nu.X();
+  caf.NuMomY = nu.Y();
+  caf.NuMomZ = nu.Z();
+
+  // interaction-level variables
+  caf.X = -q.Mag2()/(2*0.939*q.E());
+  caf.Y = q.E() / nu.E();
+  caf.Q2 = -q.Mag2();
+  caf.W = sqrt(0.939*0.939 + 2.*q.E()*0.939 + q.Mag2());
+  caf.mode = t.scatType[ii];
+  caf.Ev = t.nuE[ii];
+
+  double extraE = 0.;
+  int electron_candidates = 0;
+  int photon_candidates = 0;
+
+  // Loop over the stable final-state particles, fill particle variables
+  for( Long64_t k = t.fsBegin[ii]; k < t.fsBegin[ii+1]; ++k ) {
+
+    TLorentzVector mom( t.fsPx[k], t.fsPy[k], t.fsPz[k], t.fsE[k] );
+    double ke = mom.E() - mom.M();
+    int pdg = t.fsPdg[k];
+
+    if( abs(pdg) >= 11 && abs(pdg) <= 16 ) {
+      caf.LepPDG = pdg;
+
+      TVector3 perf = mom.Vect();
+      RotateZu( perf, nudir );
+
+      caf.LepMomX = perf.x(); // wrt true neutrino
+      caf.LepMomY = perf.y();
+      caf.LepMomZ = perf.z();
+      caf.LepE = mom.E();
+      caf.LepNuAngle = acos(perf.z()/perf.Mag());
+
+      if( abs(pdg) == 11 || abs(pdg) == 13 ) {
+        caf.isCC = 1;
+        caf.neutrinoPDG = (pdg > 0 ? pdg+1 : pdg-1);
+        caf.neutrinoPDGunosc = caf.neutrinoPDG;
+      } else {
+        caf.isCC = 0;
+        caf.neutrinoPDG = pdg;
+        caf.neutrinoPDGunosc = caf.neutrinoPDG;
       }
-
-      // Loop over all particles in this event, fill particle variables
-      GHepParticle * p = 0;
-      TIter event_iter(event);
-
-      double extraE = 0.;
-      int electron_candidates = 0;
-      int photon_candidates = 0;
-
-      while((p=dynamic_cast<GHepParticle *>(event_iter.Next()))) {
-
-        if( p->Status() == kIStStableFinalState ) {
-
-          TLorentzVector mom = *(p->P4());
-          double ke = mom.E() - mom.M();
-          int pdg = p->Pdg();
-
-          if( abs(pdg) >= 11 && abs(pdg) <= 16 ) {
-            caf.LepPDG = pdg;
-
-            TVector3 perf = mom.Vect();
-            RotateZu( perf, nudir );
-
-            caf.LepMomX = perf.x(); // wrt true neutrino
-            caf.LepMomY = perf.y();
-            caf.LepMomZ = perf.z();
-            caf.LepE = mom.E();
-            caf.LepNuAngle = acos(perf.z()/perf.Mag());
-
-            if( abs(pdg) == 11 || abs(pdg) == 13 ) {
-              caf.isCC = 1;
-              caf.neutrinoPDG = (pdg > 0 ? pdg+1 : pdg-1);
-              caf.neutrinoPDGunosc = caf.neutrinoPDG;
-            } else {
-              caf.isCC = 0;
-              caf.neutrinoPDG = pdg;
-              caf.neutrinoPDGunosc = caf.neutrinoPDG;
-            }
-          } // if lepton
-          else if( pdg == 2212 ) {caf.nP++; caf.eP += ke;}
-          else if( pdg == 2112 ) {caf.nN++; caf.eN += ke;}
-          else if( pdg ==  211 ) {caf.nipip++; caf.ePip += ke;}
-          else if( pdg == -211 ) {caf.nipim++; caf.ePim += ke;}
-          else if( pdg ==  111 ) {caf.nipi0++; caf.ePi0 += ke;}
-          else if( pdg ==  321 ) {caf.nikp++; caf.eOther += ke;}
-          else if( pdg == -321 ) {caf.nikm++; caf.eOther += ke;}
-          else if( pdg == 311 || pdg == -311 || pdg == 130 || pdg == 310 ) {caf.nik0++; caf.eOther += ke;}
-          else if( pdg ==   22 ) {caf.niem++; caf.eOther += ke;}
-          else if( pdg > 1000000000 ) caf.nNucleus++;
-          else {caf.niother++; caf.eOther += ke;}
-
-
-          // background reco stuff now
-          if( abs(pdg) == 11 ) {
-            ++electron_candidates;
-
-            TVector3 bestnudir = (vtx - origin).Unit();
-            TVector3 best = mom.Vect();
-            RotateZu( best, bestnudir );
-
-            TVector3 perf = mom.Vect();
-            RotateZu( perf, nudir );
-
-            double thetaX = 1000.*atan( best.x() / best.z() );
-            double thetaY = 1000.*atan( best.y() / best.z() );
-            double Ttrue = mom.E() - me;
-
-            double evalEsmear = esmear->Eval(Ttrue);
-            if( evalEsmear < 0. ) evalEsmear = 0.;
-
-            setDG(Ttrue);
-
-            double ereco = Ttrue * ( 1. + rando->Gaus(0., evalEsmear) );
-            double smearx = thetaX + doubleGaus->GetRandom();
-            double smeary = thetaY + doubleGaus->GetRandom();
-            double reco_theta = sqrt( smearx*smearx + smeary*smeary );
-
-            double reco_y = 1. - (ereco * (1. - cos(reco_theta/1000.)))/me;
-            double reco_enu = ereco / reco_y;
-
-            // fill CAF
-            caf.Elep_reco = ereco;
-            caf.theta_reco = 0.001*reco_theta;
-            caf.Ev_reco = reco_enu; // 2D neutrino energy reco, can sometimes be negative
-          }
-          else if( pdg == 111 ) { // pi0 production
-
-            TVector3 gamma1, gamma2;
-            TLorentzVector pi0( mom.X(), mom.Y(), mom.Z(), mom.E() );
-            decayPi0( pi0, gamma1, gamma2 ); // sets photon vectors
-
-            double evalEsmear = esmear->Eval(gamma1.Mag());
-            if( evalEsmear < 0. ) evalEsmear = 0.;
-            setDG(gamma1.Mag());
-
-            double reco_e_g1 = gamma1.Mag() * ( 1. + rando->Gaus(0., evalEsmear) );
-            double reco_e_g2 = gamma2.Mag() * ( 1. + rando->Gaus(0., evalEsmear) );
-
-            double ereco = 0.;
-            double reco_theta = 0.;
-
-            // plausible to reconstruct if a) gamma2 is < 50 MeV, b) angle is < resolution
-            if( reco_e_g2 < 0.05 ) {
-              ++photon_candidates;
-              ereco = reco_e_g1;
-              double thetaX = atan( gamma1.x() / gamma1.z() );
-              double thetaY = atan( gamma1.y() / gamma1.z() ); // convert to mrad for smearing
-              double smearx = 1000*thetaX + doubleGaus->GetRandom();
-              double smeary = 1000*thetaY + doubleGaus->GetRandom();
-              reco_theta = sqrt( smearx*smearx + smeary*smeary );
-            } else if( 1000.*gamma1.Angle(gamma2) < 5.0 ) {
-              ++photon_candidates;
-              ereco = reco_e_g1 + reco_e_g2;
-              double thetaX = atan( gamma1.x() / gamma1.z() );
-              double thetaY = atan( gamma1.y() / gamma1.z() ); // convert to mrad for smearing
-              double smearx = 1000*thetaX + doubleGaus->GetRandom();
-              double smeary = 1000*thetaY + doubleGaus->GetRandom();
-              reco_theta = sqrt( smearx*smearx + smeary*smeary );
-            } else {
-              extraE += (reco_e_g1 + reco_e_g2);
-            }
-
-            if( cat == 2 ) {
-              double reco_y = 1. - (ereco * (1. - cos(reco_theta/1000.)))/me;
-              double reco_enu = ereco / reco_y;
-
-              caf.Elep_reco = ereco;
-              caf.theta_reco = 0.001*reco_theta;
-              caf.Ev_reco = reco_enu; // 2D neutrino energy reco, can sometimes be negative
-            }  
-
-          } else if( abs(pdg) == 12 || abs(pdg) == 14 || pdg == 2112 || pdg > 9999 ) { // neutrinos, neutrons, nuclear fragments
-            continue; // skip these; they contribute nothing to extra energy
-          } else if( abs(pdg) == 211 || pdg == 2212 ) { // charged pion
-            extraE += mom.E() - mom.M();
-            if( pdg == 211 ) caf.pileup_energy = 1.; // Michel veto?
-          } else {
-            extraE += mom.E();
-          }
-        } // fsp if stable fs
-      } // fsp loop
-
-      if( electron_candidates + photon_candidates == 1 ) {
-
-        caf.Ehad_veto = extraE*1000.; // MeV
-
-        if( cat == 1 && electron_candidates == 1 && photon_candidates == 0 ) caf.fill();
-        else if( cat == 2 && electron_candidates == 0 && photon_candidates == 1 ) caf.fill();
+    } // if lepton
+    else if( pdg == 2212 ) {caf.nP++; caf.eP += ke;}
+    else if( pdg == 2112 ) {caf.nN++; caf.eN += ke;}
+    else if( pdg ==  211 ) {caf.nipip++; caf.ePip += ke;}
+    else if( pdg == -211 ) {caf.nipim++; caf.ePim += ke;}
+    else if( pdg ==  111 ) {caf.nipi0++; caf.ePi0 += ke;}
+    else if( pdg ==  321 ) {caf.nikp++; caf.eOther += ke;}
+    else if( pdg == -321 ) {caf.nikm++; caf.eOther += ke;}
+    else if( pdg == 311 || pdg == -311 || pdg == 130 || pdg == 310 ) {caf.nik0++; caf.eOther += ke;}
+    else if( pdg ==   22 ) {caf.niem++; caf.eOther += ke;}
+    else if( pdg > 1000000000 ) caf.nNucleus++;
+    else {caf.niother++; caf.eOther += ke;}
+
+
+    // background reco stuff now
+    if( abs(pdg) == 11 ) {
+      ++electron_candidates;
+
+      TVector3 bestnudir = (vtx - origin).Unit();
+      TVector3 best = mom.Vect();
+      RotateZu( best, bestnudir );
+
+      TVector3 perf = mom.Vect();
+      RotateZu( perf, nudir );
+
+      double thetaX = 1000.*atan( best.x() / best.z() );
+      double thetaY = 1000.*atan( best.y() / best.z() );
+      double Ttrue = mom.E() - me;
+
+      double evalEsmear = esmear(Ttrue);
+      if( evalEsmear < 0. ) evalEsmear = 0.;
+
+      DoubleGaussian dg = setDG(Ttrue);
+
+      double ereco = Ttrue * ( 1. + rng.Gaus(0., evalEsmear) );
+      double smearx = thetaX + dg.sample( rng );
+      double smeary = thetaY + dg.sample( rng );
+      double reco_theta = sqrt( smearx*smearx + smeary*smeary );
+
+      double reco_y = 1. - (ereco * (1. - cos(reco_theta/1000.)))/me;
+      double reco_enu = ereco / reco_y;
+
+      // fill CAF
+      caf.Elep_reco = ereco;
+      caf.theta_reco = 0.001*reco_theta;
+      caf.Ev_reco = reco_enu; // 2D neutrino energy reco, can sometimes be negative
+    }
+    else if( pdg == 111 ) { // pi0 production
+
+      TVector3 gamma1, gamma2;
+      TLorentzVector pi0( mom.X(), mom.Y(), mom.Z(), mom.E() );
+      decayPi0( pi0, gamma1, gamma2, rng ); // sets photon vectors
+
+      double evalEsmear = esmear(gamma1.Mag());
+      if( evalEsmear < 0. ) evalEsmear = 0.;
+      DoubleGaussian dg = setDG(gamma1.Mag());
+
+      double reco_e_g1 = gamma1.Mag() * ( 1. + rng.Gaus(0., evalEsmear) );
+      double reco_e_g2 = gamma2.Mag() * ( 1. + rng.Gaus(0., evalEsmear) );
+
+      double ereco = 0.;
+      double reco_theta = 0.;
+
+      // plausible to reconstruct if a) gamma2 is < 50 MeV, b) angle is < resolution
+      if( reco_e_g2 < 0.05 ) {
+        ++photon_candidates;
+        ereco = reco_e_g1;
+        double thetaX = atan( gamma1.x() / gamma1.z() );
+        double thetaY = atan( gamma1.y() / gamma1.z() ); // convert to mrad for smearing
+        double smearx = 1000*thetaX + dg.sample( rng );
+        double smeary = 1000*thetaY + dg.sample( rng );
+        reco_theta = sqrt( smearx*smearx + smeary*smeary );
+      } else if( 1000.*gamma1.Angle(gamma2) < 5.0 ) {
+        ++photon_candidates;
+        ereco = reco_e_g1 + reco_e_g2;
+        double thetaX = atan( gamma1.x() / gamma1.z() );
+        double thetaY = atan( gamma1.y() / gamma1.z() ); // convert to mrad for smearing
+        double smearx = 1000*thetaX + dg.sample( rng );
+        double smeary = 1000*thetaY + dg.sample( rng );
+        reco_theta = sqrt( smearx*smearx + smeary*smeary );
+      } else {
+        extraE += (reco_e_g1 + reco_e_g2);
       }
 
-      // clear current mc event record
-      mcrec->Clear();
+      if( cat == 2 ) {
+        double reco_y = 1. - (ereco * (1. - cos(reco_theta/1000.)))/me;
+        double reco_enu = ereco / reco_y;
+
+        caf.Elep_reco = ereco;
+        caf.theta_reco = 0.001*reco_theta;
+        caf.Ev_reco = reco_enu; // 2D neutrino energy reco, can sometimes be negative
+      }  
+
+    } else if( abs(pdg) == 12 || abs(pdg) == 14 || pdg == 2112 || pdg > 9999 ) { // neutrinos, neutrons, nuclear fragments
+      continue; // skip these; they contribute nothing to extra energy
+    } else if( abs(pdg) == 211 || pdg == 2212 ) { // charged pion
+      extraE += mom.E() - mom.M();
+      if( pdg == 211 ) caf.pileup_energy = 1.; // Michel veto?
+    } else {
+      extraE += mom.E();
+    }
+  } // fsp loop
+
+  if( electron_candidates + photon_candidates == 1 ) {
 
-    } // event loop
+    caf.Ehad_veto = extraE*1000.; // MeV
 
-  } // if bkg
+    if( cat == 1 && electron_candidates == 1 && photon_candidates == 0 ) caf.fill();
+    else if( cat == 2 && electron_candidates == 0 && photon_candidates == 1 ) caf.fill();
+  }
 }
 
-int main()
+// Give each event of the file to every category that has a CAF; cafs[cat] is NULL for the ones this job isn't
+// making. nu+e events are signal, everything else is tried as both backgrounds. Each category draws from its own
+// random streams, so a CAF comes out the same whichever others are made alongside it.
+void loop( const TruthTable &t, int ifile, CAF * cafs[] )
 {
+  for( int ii = 0; ii < t.size(); ++ii ) {
+    if( t.scatType[ii] == 7 ) { // nu+e
+      if( cafs[0] ) fillSignal( t, ifile, ii, *cafs[0] );
+    } else {
+      if( cafs[1] ) fillBkg( t, 1, ifile, ii, *cafs[1] );
+      if( cafs[2] ) fillBkg( t, 2, ifile, ii, *cafs[2] );
+    }
+  }
+}
 
-  init();
-  std::vector<unsigned int> parIds = rh.GetParameters();
-/*
-  // nu+e signal
-  CAF signal( "/dune/data/users/marshalc/CAFs/mcc11_v3/ND_nue_signal.root" );
-  for( unsigned int i = 0; i < parIds.size(); ++i ) {
-    systtools::SystParamHeader head = rh.GetHeader(parIds[i]);
-    printf( "Adding reweight branch %u for %s with %lu shifts\n", parIds[i], head.prettyName.c_str(), head.paramVariations.size() );
-    bool is_wgt = head.isWeightSystematicVariation;
-    std::string wgt_var = ( is_wgt ? "wgt" : "var" );
-    signal.addRWbranch( parIds[i], head.prettyName, wgt_var, head.paramVariations );
-    signal.iswgt[parIds[i]] = is_wgt;
+// the samples main can make, indexed by the category loop() routes events to; every GHEP file counts a fixed exposure
+struct NueSample {
+  const char * name;
+  const char * pattern; // default inputs, files 0 to 999
+  double potPerFile;
+  const char * outfile;
+};
+
+const int kNNueSamples = 3;
+const NueSample nueSamples[kNNueSamples] = {
+  { "signal", "/pnfs/dune/persistent/users/marshalc/CAF/genieNuESignal/FHC/LAr.neutrino.%d.ghep.root", 1.0E21,
+    "/dune/data/users/marshalc/CAFs/mcc11_v3/ND_nue_signal.root" },
+  { "ccbkg", "/pnfs/dune/persistent/users/marshalc/CAF/genieNuEBkg/FHC/LAr.neutrino.%d.ghep.root", 1.0E18,
+    "/dune/data/users/marshalc/CAFs/mcc11_v3/ND_nue_CCbkg.root" },
+  { "ncbkg", "/pnfs/dune/persistent/users/marshalc/CAF/genieNewFluxv2/LAr/FHC/00/LAr.neutrino.%d.ghep.root", 5.0E16,
+    "/dune/data/users/marshalc/CAFs/mcc11_v3/ND_nue_NCbkg.root" }
+};
+
+// one GHEP file of the work queue; its number keys the random streams of its events
+struct GhepInput {
+  std::string path;
+  int fileNo;
+
+  // filled in by the worker that takes it
+  int part;
+  bool used; // false if it's missing, has no gtree or was recovered
+  Long64_t first[kNNueSamples], n[kNNueSamples]; // its entries in the part's trees of each category
+  int events;
+};
+
+// the GHEP files of a file list, numbered from 0 in the order they're listed
+bool readGhepInputs( std::string filename, std::vector<GhepInput> &inputs )
+{
+  std::vector<std::string> paths;
+  if( !readFileList(filename, paths) ) return false;
+  for( unsigned int i = 0; i < paths.size(); ++i ) {
+    GhepInput in;
+    in.path = paths[i];
+    in.fileNo = inputs.size();
+    inputs.push_back( in );
   }
-  signal.pot = 0.;
-  signal.meta_run = 0;
-  signal.meta_subrun = 0;
-  signal.version = 3;
-  for( int i = 0; i <= 999; ++i ) {
-    printf( "nu+e signal file %d, so far %4.4g POT\n", i, signal.pot );
-    TFile * tf = new TFile( Form("/pnfs/dune/persistent/users/marshalc/CAF/genieNuESignal/FHC/LAr.neutrino.%d.ghep.root",i) );
-    if( tf == NULL ) delete tf;
-    else {
-      TTree * tree = (TTree*) tf->Get("gtree");
-      if( tree && !tf->TestBit(TFile::kRecovered) ) {
-        signal.pot += 1.0E21;
-        loop( tree, 0, signal );
-      }
-      delete tree;
+  return true;
+}
+
+// Takes files off the queue until there are none left, running loop() on each into this worker's CAFs, one for each
+// category being made. A file is only ever open in one worker, and each worker fills its own trees, so the threads
+// share nothing but the counter. The truth of a file comes from its table in truthDir if there is an up to date one
+// there (see makeTruthCache), otherwise from the GENIE records.
+void runWorker( int part, double potPerFile, std::string truthDir, std::vector<GhepInput> * inputs, std::atomic<int> * next, CAF ** cafs )
+{
+  TruthTable table;
+  for( int i = (*next)++; i < (int) inputs->size(); i = (*next)++ ) {
+    GhepInput &in = (*inputs)[i];
+    in.part = part;
+    bool ok = ( !truthDir.empty() && table.read(truthPath(in.path, truthDir), in.path) );
+    if( !ok ) {
+      TFile * tf = new TFile( in.path.c_str() );
+      TTree * tree = ( tf->IsZombie() ? NULL : (TTree*) tf->Get("gtree") );
+      if( tree == NULL ) printf( "File %d %s has no gtree, skipping it\n", in.fileNo, in.path.c_str() );
+      else if( tf->TestBit(TFile::kRecovered) ) printf( "File %d %s was recovered, skipping it\n", in.fileNo, in.path.c_str() );
+      else ok = table.fill( tree );
       tf->Close();
       delete tf;
     }
+    if( !ok ) continue;
+
+    for( int c = 0; c < kNNueSamples; ++c ) {
+      if( cafs[c] ) in.first[c] = cafs[c]->cafMVA->GetEntries();
+    }
+    loop( table, in.fileNo, cafs );
+    in.events = table.size();
+    in.used = true;
+    std::string selected;
+    for( int c = 0; c < kNNueSamples; ++c ) {
+      if( cafs[c] == NULL ) continue;
+      in.n[c] = cafs[c]->cafMVA->GetEntries() - in.first[c];
+      cafs[c]->pot += potPerFile;
+      selected += Form( ", %lld %s", in.n[c], nueSamples[c].name );
+    }
+    printf( "File %d: %d events%s\n", in.fileNo, in.events, selected.c_str() );
   }
-  signal.fillPOT();
-  signal.write();
-
-
-  // nu_e CC background
-  CAF bkg1( "/dune/data/users/marshalc/CAFs/mcc11_v3/ND_nue_CCbkg.root" );
-  for( unsigned int i = 0; i < parIds.size(); ++i ) {
-    systtools::SystParamHeader head = rh.GetHeader(parIds[i]);
-    printf( "Adding reweight branch %u for %s with %lu shifts\n", parIds[i], head.prettyName.c_str(), head.paramVariations.size() );
-    bool is_wgt = head.isWeightSystematicVariation;
-    std::string wgt_var = ( is_wgt ? "wgt" : "var" );
-    bkg1.addRWbranch( parIds[i], head.prettyName, wgt_var, head.paramVariations );
-    bkg1.iswgt[parIds[i]] = is_wgt;
+}
+
+// path without its .root
+std::string rootStem( std::string path )
+{
+  if( path.size() > 5 && path.compare(path.size() - 5, 5, ".root") == 0 ) path.erase( path.size() - 5 );
+  return path;
+}
+
+// Copy the workers' parts of category cat into outfile file by file, so the events are in the order one thread would
+// have written them, with one meta entry for the POT of all the files that were used
+bool mergeParts( std::string outfile, const std::vector<std::string> &parts, const std::vector<GhepInput> &inputs, int cat,
+                 double pot, const IOProfile &profile )
+{
+  int nparts = parts.size();
+  std::vector<TFile*> files( nparts );
+  std::vector<TTree*> cafs( nparts );
+  std::vector<TTree*> genies( nparts );
+  TTree * meta0 = NULL;
+  for( int p = 0; p < nparts; ++p ) {
+    files[p] = new TFile( parts[p].c_str() );
+    cafs[p] = ( files[p]->IsZombie() ? NULL : (TTree*) files[p]->Get("caf") );
+    genies[p] = ( files[p]->IsZombie() ? NULL : (TTree*) files[p]->Get("genieEvt") );
+    if( p == 0 && !files[p]->IsZombie() ) meta0 = (TTree*) files[p]->Get( "meta" );
+    if( cafs[p] == NULL || genies[p] == NULL || (p == 0 && meta0 == NULL) ) {
+      printf( "Can't read part %s\n", parts[p].c_str() );
+      return false;
+    }
   }
-  bkg1.pot = 0.;
-  bkg1.meta_run = 0;
-  bkg1.meta_subrun = 0;
-  bkg1.version = 3;
-  for( int i = 0; i <= 999; ++i ) {
-    printf( "nue CC background file %d, so far %4.4g POT\n", i, bkg1.pot );
-    TFile * tf = new TFile( Form("/pnfs/dune/persistent/users/marshalc/CAF/genieNuEBkg/FHC/LAr.neutrino.%d.ghep.root",i) );
-    if( tf != NULL ) {
-      TTree * tree = (TTree*) tf->Get("gtree");
-      if( tree && !tf->TestBit(TFile::kRecovered) ) {
-        bkg1.pot += 1.0E18;
-        loop( tree, 1, bkg1 );
-      }
-      tf->Close();
+
+  // the parts were written fast; the clones get the compression of the output file
+  TFile * out = new TFile( outfile.c_str(), "RECREATE" );
+  applyIOProfile( profile, out );
+  TTree * caf = cafs[0]->CloneTree( 0 );
+  TTree * genie = genies[0]->CloneTree( 0 );
+  TTree * meta = meta0->CloneTree( 0 );
+  TTree * trees[] = { caf, meta, genie };
+  for( int t = 0; t < 3; ++t ) {
+    TObjArray * branches = trees[t]->GetListOfBranches();
+    for( int b = 0; b < branches->GetEntriesFast(); ++b ) ((TBranch*) branches->At(b))->SetCompressionSettings( out->GetCompressionSettings() );
+    applyIOProfile( profile, trees[t] );
+  }
+  for( int p = 1; p < nparts; ++p ) {
+    cafs[p]->CopyAddresses( caf );
+    genies[p]->CopyAddresses( genie );
+  }
+
+  for( unsigned int i = 0; i < inputs.size(); ++i ) {
+    const GhepInput &in = inputs[i];
+    for( Long64_t e = in.first[cat]; e < in.first[cat] + in.n[cat]; ++e ) {
+      cafs[in.part]->GetEntry( e );
+      caf->Fill();
+      genies[in.part]->GetEntry( e );
+      genie->Fill();
     }
-    delete tf;
   }
-  bkg1.fillPOT();
-  bkg1.write();
-*/
 
-  // NC background
-  CAF bkg2( "/dune/data/users/marshalc/CAFs/mcc11_v3/ND_nue_NCbkg.root" );
-  for( unsigned int i = 0; i < parIds.size(); ++i ) {
-    systtools::SystParamHeader head = rh.GetHeader(parIds[i]);
-    printf( "Adding reweight branch %u for %s with %lu shifts\n", parIds[i], head.prettyName.c_str(), head.paramVariations.size() );
-    bool is_wgt = head.isWeightSystematicVariation;
-    std::string wgt_var = ( is_wgt ? "wgt" : "var" );
-    bkg2.addRWbranch( parIds[i], head.prettyName, wgt_var, head.paramVariations );
-    bkg2.iswgt[parIds[i]] = is_wgt;
+  // the rest of the meta entry is the same in every part
+  meta0->GetEntry( 0 );
+  double totalPot = pot;
+  meta->SetBranchAddress( "pot", &totalPot );
+  meta->Fill();
+
+  out->cd();
+  for( int t = 0; t < 3; ++t ) trees[t]->Write();
+  printf( "Merged %d parts into %s: %lld events\n", nparts, outfile.c_str(), caf->GetEntries() );
+  out->Close();
+  delete out;
+
+  for( int p = 0; p < nparts; ++p ) {
+    files[p]->Close();
+    delete files[p];
+    unlink( parts[p].c_str() );
+  }
+  return true;
+}
+
+// Any of the samples, from the default files of the first one named or a list of files:
+//   nueElasticCAF --sample signal,ccbkg,ncbkg [--filelist FILE] [--pot-per-file POT] [--outfile FILE] [--threads N]
+//                 [--truth-cache DIR]
+// With several samples every file is read once and each event goes to all the samples it belongs to; the files'
+// POT counts for each of them. The outputs are the samples' usual files, or FILE_signal.root etc. with --outfile FILE.
+// With more than one thread, the files are shared out from a queue as the workers become free; each worker writes
+// its own parts next to the outputs, and at the end the parts are merged into the outputs in file order.
+int main( int argc, char const *argv[] )
+{
+
+  // resolution functions by name
+  std::string esmearName = "nue_energy";
+  std::string coreName = "nue_theta_core";
+  std::string tailName = "nue_theta_tail";
+  std::string ratioName = "nue_theta_ratio";
+  std::string sampleList = "ncbkg";
+  std::string filelist = "";
+  std::string outfile = "";
+  std::string ioProfile = "default";
+  std::string truthDir = "";
+  double potPerFile = -1.;
+  int nthreads = 1;
+  int i = 1;
+  while( i < argc ) {
+    if( argv[i] == std::string("--esmear") ) {
+      esmearName = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--theta-core") ) {
+      coreName = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--theta-tail") ) {
+      tailName = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--theta-ratio") ) {
+      ratioName = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--sample") ) {
+      sampleList = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--filelist") ) {
+      filelist = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--pot-per-file") ) {
+      potPerFile = atof( argv[i+1] );
+      i += 2;
+    } else if( argv[i] == std::string("--outfile") ) {
+      outfile = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--io-profile") ) {
+      ioProfile = argv[i+1];
+      i += 2;
+    } else if( argv[i] == std::string("--threads") ) {
+      nthreads = atoi( argv[i+1] );
+      i += 2;
+    } else if( argv[i] == std::string("--truth-cache") ) {
+      truthDir = argv[i+1];
+      i += 2;
+    } else i += 1;
+  }
+
+  if( !init(esmearName, coreName, tailName, ratioName) ) return 1;
+
+  // which categories to make; the first one named picks the default files
+  bool make[kNNueSamples] = { false, false, false };
+  int nmake = 0;
+  const NueSample * first = NULL;
+  std::stringstream ss( sampleList );
+  std::string name;
+  while( std::getline(ss, name, ',') ) {
+    int s = 0;
+    while( s < kNNueSamples && name != nueSamples[s].name ) ++s;
+    if( s == kNNueSamples ) {
+      printf( "Unknown sample %s, choose from: signal ccbkg ncbkg\n", name.c_str() );
+      return 1;
+    }
+    if( first == NULL ) first = &nueSamples[s];
+    if( !make[s] ) ++nmake;
+    make[s] = true;
+  }
+  if( first == NULL ) {
+    printf( "--sample needs at least one of signal ccbkg ncbkg\n" );
+    return 1;
+  }
+  const IOProfile * profile = getIOProfile( ioProfile );
+  if( profile == NULL ) {
+    printf( "Unknown I/O profile %s\n", ioProfile.c_str() );
+    return 1;
   }
-  bkg2.pot = 0.;
-  bkg2.meta_run = 0;
-  bkg2.meta_subrun = 0;
-  bkg2.version = 3;
-  int nevt = 0;
-  for( int i = 0; i <= 999; ++i ) {
-    printf( "NC background file %d, so far %4.4g POT for %d events\n", i, bkg2.pot, nevt );
-    TFile * tf = new TFile( Form("/pnfs/dune/persistent/users/marshalc/CAF/genieNewFluxv2/LAr/FHC/00/LAr.neutrino.%d.ghep.root",i) );
-    if( tf != NULL ) {
-      TTree * tree = (TTree*) tf->Get("gtree");
-      if( tree && !tf->TestBit(TFile::kRecovered) ) {
-        bkg2.pot += 5.0E16;
-        loop( tree, 2, bkg2 );
-        nevt += tree->GetEntries();
+  if( potPerFile < 0. ) potPerFile = first->potPerFile;
+  if( nthreads < 1 ) nthreads = 1;
+
+  std::string outfiles[kNNueSamples];
+  for( int c = 0; c < kNNueSamples; ++c ) {
+    if( outfile.empty() ) outfiles[c] = nueSamples[c].outfile;
+    else if( nmake == 1 ) outfiles[c] = outfile;
+    else outfiles[c] = Form( "%s_%s.root", rootStem(outfile).c_str(), nueSamples[c].name );
+  }
+
+  std::vector<GhepInput> inputs;
+  if( !filelist.empty() ) {
+    if( !readGhepInputs(filelist, inputs) ) return 1;
+  } else {
+    for( int f = 0; f <= 999; ++f ) {
+      GhepInput in;
+      in.path = Form( first->pattern, f );
+      in.fileNo = f;
+      inputs.push_back( in );
+    }
+  }
+  for( unsigned int f = 0; f < inputs.size(); ++f ) {
+    inputs[f].part = -1;
+    inputs[f].used = false;
+    inputs[f].events = 0;
+    for( int c = 0; c < kNNueSamples; ++c ) {
+      inputs[f].first[c] = 0;
+      inputs[f].n[c] = 0;
+    }
+  }
+  if( nthreads > (int) inputs.size() ) nthreads = std::max( 1, (int) inputs.size() );
+  printf( "Making %s from %lu files with %d threads, %g POT per file\n", sampleList.c_str(), inputs.size(), nthreads, potPerFile );
+
+  // one thread writes the outputs directly, several write parts that are merged at the end
+  std::vector<std::string> parts[kNNueSamples];
+  if( nthreads > 1 ) ROOT::EnableThreadSafety();
+  for( int c = 0; c < kNNueSamples; ++c ) {
+    if( !make[c] ) continue;
+    for( int t = 0; t < nthreads; ++t ) parts[c].push_back( nthreads == 1 ? outfiles[c] : std::string(Form("%s_part%d.root", rootStem(outfiles[c]).c_str(), t)) );
+  }
+
+  // the reweight branches are set up here, the workers only fill
+  std::vector<unsigned int> parIds = rh.GetParameters();
+  std::vector<CAF*> cafs( nthreads * kNNueSamples, (CAF*) NULL ); // [thread][category]
+  bool announce = true;
+  for( int t = 0; t < nthreads; ++t ) {
+    for( int c = 0; c < kNNueSamples; ++c ) {
+      if( !make[c] ) continue;
+      CAF * caf = new CAF( parts[c][t], false, kGenieFull, (nthreads == 1 ? ioProfile : "fast") );
+      for( unsigned int p = 0; p < parIds.size(); ++p ) {
+        systtools::SystParamHeader head = rh.GetHeader(parIds[p]);
+        if( announce ) printf( "Adding reweight branch %u for %s with %lu shifts\n", parIds[p], head.prettyName.c_str(), head.paramVariations.size() );
+        bool is_wgt = head.isWeightSystematicVariation;
+        std::string wgt_var = ( is_wgt ? "wgt" : "var" );
+        caf->addRWbranch( parIds[p], head.prettyName, wgt_var, head.paramVariations );
+        caf->iswgt[parIds[p]] = is_wgt;
       }
-      tf->Close();
+      caf->pot = 0.;
+      caf->meta_run = 0;
+      caf->meta_subrun = 0;
+      caf->version = 3;
+      cafs[t*kNNueSamples + c] = caf;
+      announce = false;
     }
-    delete tf;
   }
-  bkg2.fillPOT();
-  bkg2.write();
-  printf( "Got %g POT for %d events\n", bkg2.pot, nevt );
 
-}
+  std::atomic<int> next( 0 );
+  if( nthreads == 1 ) runWorker( 0, potPerFile, truthDir, &inputs, &next, &cafs[0] );
+  else {
+    std::vector<std::thread> threads;
+    for( int t = 0; t < nthreads; ++t ) threads.push_back( std::thread(runWorker, t, potPerFile, truthDir, &inputs, &next, &cafs[t*kNNueSamples]) );
+    for( int t = 0; t < nthreads; ++t ) threads[t].join();
+  }
 
+  double pot = 0.;
+  int nevt = 0, nused = 0;
+  for( unsigned int f = 0; f < inputs.size(); ++f ) {
+    if( !inputs[f].used ) continue;
+    pot += potPerFile;
+    nevt += inputs[f].events;
+    ++nused;
+  }
+  for( unsigned int k = 0; k < cafs.size(); ++k ) {
+    if( cafs[k] == NULL ) continue;
+    cafs[k]->fillPOT();
+    cafs[k]->write();
+    delete cafs[k];
+  }
+  for( int c = 0; c < kNNueSamples; ++c ) {
+    if( make[c] && nthreads > 1 && !mergeParts(outfiles[c], parts[c], inputs, c, pot, *profile) ) return 1;
+  }
+  printf( "Got %g POT for %d events from %d of %lu files\n", pot, nevt, nused, inputs.size() );
+  return 0;
+}
@@ -129,21 +129,15 @@ setup genie_phyopt v2_12_10     -q dkcharmtau
 setup geant4       v4_10_3_p01b -q e15:prof
 setup ifdhc
 export LD_LIBRARY_PATH=${LD_LIBRARY_PATH}:${PWD}/nusystematics/build/Linux/lib:${PWD}/nusyst/artless
+export LD_LIBRARY_PATH=${LD_LIBRARY_PATH}:${PWD}/edep-sim/edep-gcc-6.4.0-x86_64-pc-linux-gnu/lib
 
-## Run dumpTree
-echo "Running dumpTree.py..."
-echo "python dumpTree.py --topdir ${PWD} --first_run ${RNDSEED} --last_run ${RNDSEED} ${RHC} --grid --outfile dump.root"
-python dumpTree.py --topdir ${PWD} --first_run ${RNDSEED} --last_run ${RNDSEED} ${RHC} --grid --outfile dump.root
-
-## Run makeCAF
+## Run makeCAF, reading the edep-sim files directly
 echo "Running makeCAF..."
-echo "./makeCAF --edepfile dump.root --ghepdir ${PWD} --outfile CAF.root --fhicl fhicl.fcl --seed ${RNDSEED} --grid ${RHC}"
-./makeCAF --edepfile dump.root --ghepdir ${PWD} --outfile CAF.root --fhicl ./fhicl.fcl --seed ${RNDSEED} ${RHC} --grid
+echo "./makeCAF --edepsim --edepdir ${PWD} --first_run ${RNDSEED} --last_run ${RNDSEED} --ghepdir ${PWD} --outfile CAF.root --fhicl fhicl.fcl --seed ${RNDSEED} --grid ${RHC}"
+./makeCAF --edepsim --edepdir ${PWD} --first_run ${RNDSEED} --last_run ${RNDSEED} --ghepdir ${PWD} --outfile CAF.root --fhicl ./fhicl.fcl --seed ${RNDSEED} ${RHC} --grid
 
 ## copy outputs
 echo "Copying outputs..."
-echo "${CP} dump.root ${DUMPDIR}/${HORN}_${RNDSEED}.root"
-${CP} dump.root ${DUMPDIR}/${HORN}_${RNDSEED}.root
 echo "${CP} CAF.root ${CAFDIR}/CAF_${HORN}_${RNDSEED}.root"
 ${CP} CAF.root ${CAFDIR}/CAF_${HORN}_${RNDSEED}.root
 
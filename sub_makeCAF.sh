@@ -1,9 +1,7 @@
 #! /usr/bin/env bash
 
 # This script is intended for submitting ND CAF-maker to the Fermilab grid
-# It first runs dumpTree (extract edep-sim output to flat tree)
-# Then runs makeCAF (create CAF file from extracted output)
-# The intermediate flat tree is also saved
+# It runs makeCAF directly on the edep-sim output (create CAF file from edep-sim and GENIE output)
 # Syntax for the jobsub_submit command is:
 # jobsub_submit --group dune --role=Analysis -N 100 --OS=SL6 --expected-lifetime=12h --memory=2000MB --group=dune file://`pwd`/sub_makeCAF.sh FHC 50
 ##################################################
@@ -97,23 +95,16 @@ echo "Getting edep-sim and nusyst code"
 ${CP} ${STUFF} DUNE_ND_CAF.tar.gz
 tar xzf DUNE_ND_CAF.tar.gz
 mv DUNE_ND_CAF/* .
-#export LD_LIBRARY_PATH=${LD_LIBRARY_PATH}:${PWD}/edep-sim/lib
+export LD_LIBRARY_PATH=${LD_LIBRARY_PATH}:${PWD}/edep-sim/lib
 export LD_LIBRARY_PATH=${LD_LIBRARY_PATH}:${PWD}/nusystematics/build/Linux/lib:${PWD}/nusyst/artless
 
-## Run dumpTree
-echo "Running dumpTree.py..."
-echo "python dumpTree.py --topdir ${PWD} --first_run ${FIRSTRUN} --last_run ${LASTRUN} ${RHC} --grid --outfile dump.root"
-python dumpTree.py --topdir ${PWD} --first_run ${FIRSTRUN} --last_run ${LASTRUN} ${RHC} --grid --outfile dump.root
-
-## Run makeCAF
+## Run makeCAF, reading the edep-sim files directly
 echo "Running makeCAF..."
-echo "./makeCAF --edepfile dump.root --ghepdir ${PWD} --outfile CAF.root --fhicl fhicl.fcl --seed ${PROCESS} --grid ${RHC}"
-./makeCAF --edepfile dump.root --ghepdir ${PWD} --outfile CAF.root --fhicl ./fhicl.fcl --seed ${PROCESS} ${RHC} --grid
+echo "./makeCAF --edepsim --edepdir ${PWD} --first_run ${FIRSTRUN} --last_run ${LASTRUN} --ghepdir ${PWD} --outfile CAF.root --fhicl fhicl.fcl --seed ${PROCESS} --grid ${RHC}"
+./makeCAF --edepsim --edepdir ${PWD} --first_run ${FIRSTRUN} --last_run ${LASTRUN} --ghepdir ${PWD} --outfile CAF.root --fhicl ./fhicl.fcl --seed ${PROCESS} ${RHC} --grid
 
 ## copy outputs
 echo "Copying outputs..."
-echo "${CP} dump.root ${DUMPDIR}/${HORN}_${PROCESS}.root"
-${CP} dump.root ${DUMPDIR}/${HORN}_${PROCESS}.root
 echo "${CP} CAF.root ${CAFDIR}/CAF_${HORN}_${PROCESS}.root"
 ${CP} CAF.root ${CAFDIR}/CAF_${HORN}_${PROCESS}.root
 